@@ -36,8 +36,7 @@ Type* BoolConstant::Check(Symtab* S) {
 }
 
 Type* VarExpr::Check(Symtab* S) {
-  Decl* findMe = new VarDecl(id, Type::intType);
-  return S->findType(findMe);
+  return S->findType(id);
 }
 
 IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
@@ -0,0 +1,47 @@
+#! /bin/sh
+# Times the checker on generated shaders with N global declarations, each
+# read and then shadowed in its own block inside one function. The last
+# statement reads a local of an exited block, so exactly one "No
+# declaration" error is expected. Fails if the output differs or if the
+# time per declaration at the largest N is over 3x that at the smallest.
+#   ./bench_symtab.sh [N ...]
+
+[ -x glc ] || { echo "Error: glc not executable"; exit 1; }
+
+SIZES="$*"
+[ -n "$SIZES" ] || SIZES="1000 2000 4000 8000 16000 32000"
+
+TMP=${TMPDIR:-/tmp}/bench_symtab.$$
+trap 'rm -f $TMP.glsl $TMP.err' 0
+
+status=0
+first=
+for n in $SIZES; do
+	awk -v n=$n 'BEGIN {
+		for (i = 0; i < n; i++) printf "float g%d;\n", i;
+		print "float f() {\n  float s;\n  s = 0.0;";
+		for (i = 0; i < n; i++)
+			printf "  s = s + g%d;\n  { float g%d; float h%d; g%d = s; h%d = g%d; s = h%d; }\n", i, i, i, i, i, i, i;
+		print "  s = s + h0;\n  return s;\n}";
+	}' > $TMP.glsl
+	start=`date +%s%N`
+	./glc < $TMP.glsl > /dev/null 2> $TMP.err
+	end=`date +%s%N`
+	errs=`grep -c '^\*\*\* Error' $TMP.err`
+	if [ "$errs" != 1 ] || ! grep -q "No declaration found for variable 'h0'" $TMP.err; then
+		echo "$n decls: FAIL, expected one undeclared 'h0' error"
+		cat $TMP.err
+		status=1
+		continue
+	fi
+	ns=$(( (end - start) / n ))
+	echo "$n decls: $(( (end - start) / 1000000 )) ms, $ns ns/decl"
+	[ -n "$first" ] || first=$ns
+	last=$ns
+done
+
+if [ -n "$first" ] && [ $last -gt $(( 3 * first )) ]; then
+	echo "FAIL: time per declaration grew from $first to $last ns"
+	status=1
+fi
+exit $status
@@ -2,7 +2,6 @@
 #include "symtab.h"
 
 Symtab::Symtab() {
-    table = new vector<map<Decl*, Type*>*>();
     levelNumber = 0;
 }
 
@@ -10,8 +9,15 @@ int Symtab::getLevelNumber() {
     return levelNumber;
 }
 
+// innermost visible entry for name, or -1
+int Symtab::lookup(const char *name) {
+    key.assign(name);
+    unordered_map<string, int>::iterator it = heads.find(key);
+    return it == heads.end() ? -1 : it->second;
+}
+
 void Symtab::enterScope() {
-    table->push_back(new map<Decl*,Type*>());
+    scopeStart.push_back(entries.size());
     levelNumber++;
 }
 
@@ -20,52 +26,54 @@ bool Symtab::insert(pair<Decl*,Type*> var) {
         cout << "No Scope" << endl;
         return false;
     }
-    if (Decl* temp = (find(var.first, levelNumber - 1))) {
-        ReportError::DeclConflict(var.first, temp);
+    // element references survive rehashing, so entries can keep head
+    int *head = &heads.insert(make_pair(string(var.first->getId()), -1))
+                      .first->second;
+    if (*head != -1 && entries[*head].level == levelNumber - 1) {
+        ReportError::DeclConflict(var.first, entries[*head].decl);
         return false;
     }
-    table->at(levelNumber - 1)->insert(var);
+    entry e = { var.first, var.second, head, levelNumber - 1, *head };
+    *head = entries.size();
+    entries.push_back(e);
     return true;
 }
 
-bool comparator(Decl* a, Decl* b) {
-    return (strcmp(a->getId(),b->getId()) == 0);
+Decl* Symtab::find(Decl* var, int x) {
+    for (int e = lookup(var->getId()); e != -1 && entries[e].level >= x;
+         e = entries[e].prev)
+        if (entries[e].level == x)
+            return entries[e].decl;
+    return NULL;
 }
 
-Decl* Symtab::find(Decl* var, int x) {
-    map<Decl*, Type*> currMap = *table->at(x);
-    for (map<Decl*,Type*>::iterator it=currMap.begin();it!=currMap.end();++it) {
-        if (comparator(it->first, var)) 
-            return it->first;
-    }
+Type* Symtab::findType(Identifier* id) {
+    int e = lookup(id->getName());
+    if (e != -1)
+        return entries[e].type;
+    ReportError::IdentifierNotDeclared(id, LookingForVariable);
     return NULL;
 }
 
 Type* Symtab::findType(Decl* var) {
-    for (int i = levelNumber - 1; i >= 0; i--) {
-        map<Decl*, Type*> currMap = *table->at(i);
-        for (map<Decl*,Type*>::iterator it=currMap.begin();it!=currMap.end();++it) {
-            if (comparator(it->first, var)) 
-                return it->second;
-        }
-    }
-    ReportError::IdentifierNotDeclared(var->getIdentifier(),
-                                       LookingForVariable);
-    return NULL;
+    return findType(var->getIdentifier());
 }
+
 bool Symtab::find(Decl* var) {
-    for (int i = levelNumber - 1; i >= 0; i++) {
-        if (find(var, i))
-            return true;
-    }
-    //TODO: No declaration Error
+    if (lookup(var->getId()) != -1)
+        return true;
     ReportError::IdentifierNotDeclared(var->getIdentifier(), 
                                        LookingForVariable);
     return false;
 }
 
 void Symtab::exitScope() {
-    table->pop_back();
+    size_t start = scopeStart.back();
+    scopeStart.pop_back();
+    while (entries.size() > start) {
+        *entries.back().head = entries.back().prev;
+        entries.pop_back();
+    }
     levelNumber--;
 }
 
@@ -74,17 +82,17 @@ void Symtab::printTable(int x) {
         cout << x << " Invalid Level" << endl;
         return;
     }
-    map<Decl*, Type*> currMap = *table->at(x);
-    if (currMap.empty()) {
+    size_t end = x + 1 < levelNumber ? scopeStart[x + 1] : entries.size();
+    if (scopeStart[x] == end) {
         cout << "EMPTY LEVEL" << endl;
         return;
     }
-    for (map<Decl*, Type*>::iterator it = currMap.begin(); it!=currMap.end(); ++it)
-        cout << it->first << " => " << it->second << endl;
+    for (size_t e = scopeStart[x]; e < end; e++)
+        cout << entries[e].decl << " => " << entries[e].type << endl;
 }
 
 void Symtab::printTable() {
-    if (table->empty()) {
+    if (levelNumber == 0) {
         cout << "EMPTY TABLE" << endl;
         return;
     }
@@ -4,15 +4,34 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string.h>
 using namespace std;
 
 class Type;
 class Decl;
+class Identifier;
+
+/* Each name maps to the innermost of its live declarations, which link
+ * to the ones they shadow, so a lookup is one hash probe however deeply
+ * scopes nest. exitScope unwinds the entries stack to restore them.
+ */
 class Symtab {
     protected:
-        vector<map<Decl*, Type*>*> *table;
+        struct entry {
+            Decl *decl;
+            Type *type;
+            int *head;      // heads slot of this name
+            int level;
+            int prev;       // entry this one shadows, or -1
+        };
+        unordered_map<string, int> heads;   // innermost entry, or -1
+        string key;                 // reused so lookups don't allocate
+        vector<entry> entries;
+        vector<size_t> scopeStart;  // entries.size() on scope entry
         int levelNumber;
+
+        int lookup(const char *);
     public:
         Symtab();
         int getLevelNumber();
@@ -21,6 +40,7 @@ class Symtab {
         Decl* find(Decl*, int);
         bool find(Decl*);
         Type* findType(Decl*);
+        Type* findType(Identifier*);
         void exitScope();
         void printTable(int);
         void printTable();
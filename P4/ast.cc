@@ -8,18 +8,38 @@
 #include <string.h> // strdup
 #include <stdio.h>  // printf
 
-Symtab* Node::S = new Symtab();
-IRGenerator* Node::irgen = new IRGenerator();
-llvm::BasicBlock *Node::breakB = NULL;
-llvm::BasicBlock *Node::continueB = NULL;
-llvm::SwitchInst *Node::switchI = NULL;
-Node::Node(yyltype loc) {
-    location = new yyltype(loc);
+thread_local Symtab* Node::S = NULL;
+thread_local IRGenerator* Node::irgen = new IRGenerator();
+thread_local llvm::BasicBlock *Node::breakB = NULL;
+thread_local llvm::BasicBlock *Node::continueB = NULL;
+/* Nodes are bump-allocated from large chunks in creation order and never
+ * freed, so allocating one is a pointer increment instead of a malloc.
+ */
+static const size_t ArenaChunkSize = 64 * 1024;
+static const size_t ArenaAlign = 16;
+static thread_local char *arenaNext = NULL;
+static thread_local char *arenaEnd = NULL;
+
+void *Node::operator new(size_t size) {
+    size = (size + ArenaAlign - 1) & ~(ArenaAlign - 1);
+    if (arenaNext == NULL || (size_t)(arenaEnd - arenaNext) < size) {
+        size_t chunk = size > ArenaChunkSize ? size : ArenaChunkSize;
+        arenaNext = (char *)malloc(chunk);
+        if (arenaNext == NULL)
+            Failure("Out of memory for AST nodes");
+        arenaEnd = arenaNext + chunk;
+    }
+    void *p = arenaNext;
+    arenaNext += size;
+    return p;
+}
+
+Node::Node(SourceRange loc) {
+    location = loc;
     parent = NULL;
 }
 
 Node::Node() {
-    location = NULL;
     parent = NULL;
 }
 
@@ -34,8 +54,8 @@ Node::Node() {
 void Node::Print(int indentLevel, const char *label) { 
     const int numSpaces = 3;
     printf("\n");
-    if (GetLocation()) 
-        printf("%*d", numSpaces, GetLocation()->first_line);
+    if (location.IsValid()) 
+        printf("%*d", numSpaces, LineOf(location.begin));
     else 
         printf("%*s", numSpaces, "");
     printf("%*s%s%s: ", indentLevel*numSpaces, "", 
@@ -7,8 +7,8 @@
  * more correctly, of instances of concrete subclassses such as VarDecl,
  * ForStmt, and AssignExpr).
  * 
- * Location: Each node maintains its lexical location (line and columns in 
- * file), that location can be NULL for those nodes that don't care/use 
+ * Location: Each node maintains its lexical location as a SourceRange (see
+ * location.h), which is empty for those nodes that don't care/use
  * locations. The location is typcially set by the node constructor.  The 
  * location is used to provide the context when reporting semantic errors.
  *
@@ -39,22 +39,27 @@
 #include <stdlib.h>   // for NULL
 #include "location.h"
 #include "symtab.h"
+#include "trace.h"
 
 class Node  {
   protected:
-    yyltype *location;
+    SourceRange location;
     Node *parent;
 
   public:
-    Node(yyltype loc);
+    Node(SourceRange loc);
     Node();
     virtual ~Node() {}
-    static llvm::BasicBlock *breakB;
-    static llvm::BasicBlock *continueB;
-    static llvm::SwitchInst *switchI;
-    static Symtab* S;
-    static IRGenerator* irgen;
-    yyltype *GetLocation()   { return location; }
+    // nodes come from a per-thread bump arena and live until exit
+    static void *operator new(size_t size);
+    static void operator delete(void *) {}
+    // per thread: every thread starts with its own generator, so
+    // -femit-threads workers emit into contexts of their own
+    static thread_local llvm::BasicBlock *breakB;
+    static thread_local llvm::BasicBlock *continueB;
+    static thread_local Symtab* S;
+    static thread_local IRGenerator* irgen;
+    SourceRange GetLocation() { return location; }
     void SetParent(Node *p)  { parent = p; }
     Node *GetParent()        { return parent; }
 
@@ -65,6 +70,9 @@ class Node  {
     void Print(int indentLevel, const char *label = NULL); 
     virtual void PrintChildren(int indentLevel)  {}
     virtual llvm::Value*  Emit() { return NULL;}
+    // binds every name to its declaration ahead of Emit(), using S for
+    // the scopes; Emit() itself never looks a name up
+    virtual void Resolve() {}
 };
    
 
@@ -5,11 +5,15 @@
 #include "ast_decl.h"
 #include "ast_type.h"
 #include "ast_stmt.h"
+#include "ast_expr.h"
+#include "errors.h"
         
          
-Decl::Decl(Identifier *n) : Node(*n->GetLocation()) {
+Decl::Decl(Identifier *n) : Node(n->GetLocation()) {
     Assert(n != NULL);
     (id=n)->SetParent(this); 
+    slot = NULL;
+    storage = INVALID;
 }
 
 llvm::Value* Decl::Emit() {
@@ -22,49 +26,146 @@ llvm::Value* Decl::Emit() {
 }
 
 llvm::Value* VarDecl::Emit() {
-    if (DEBUG)
-        cout << "VarDecl" << endl;
+    TRACE(TraceEmit, "VarDecl");
     llvm::Module *mod = irgen->GetOrCreateModule("mod");
     const llvm::Twine tw(getId());
     llvm::Type* t = getType()->convert();
-    container c;
-    if (Node::S->getLevelNumber() == 1) {
+    llvm::Value* initVal = NULL;
+    if (init && precise)
+        Node::irgen->BeginPrecise();
+    if (init)
+        initVal = Node::irgen->CreateConversion(init->Emit(), t);
+    if (init && precise)
+        Node::irgen->EndPrecise();
+    if (constant && initVal) {
+        // no storage: every read is the value itself, which Resolve()
+        // has checked is constant
+        Bind(initVal, CONSTANT);
+    }
+    else if (storage == GLOBAL) {
+        // Resolve() only lets constant initializers through
+        llvm::Constant* initC = initVal ? llvm::cast<llvm::Constant>(initVal)
+                                        : llvm::Constant::getNullValue(t);
         llvm::Value* val = new llvm::GlobalVariable(
             *mod,
             t, 
-            false, 
-            llvm::GlobalValue::ExternalLinkage, 
-            llvm::Constant::getNullValue(t), 
+            IsReadOnly(), 
+            IsReadOnly() ? llvm::GlobalValue::InternalLinkage
+                         : llvm::GlobalValue::ExternalLinkage, 
+            initC, 
             tw);
-        c.decl = this;
-        c.val = val;
-        c.flag = GLOBAL;
+        Bind(val, GLOBAL);
     }
     else {
         llvm::BasicBlock* bb = Node::irgen->GetBasicBlock();
-        llvm::Value *val =  new llvm::AllocaInst(t, tw, bb);
-        c.decl = this;
-        c.val = val;
-        c.flag = LOCAL;
+        // locals live in the entry block so loops never re-execute allocas
+        llvm::Value *val = Node::irgen->CreateEntryAlloca(t, getId());
+        if (initVal)
+            new llvm::StoreInst(initVal, val, bb);
+        Bind(val, LOCAL);
     }
-    Node::S->insert(make_pair(getId(), c));
     return NULL;
 }
 
-llvm::Value* FnDecl::Emit() {
-    if (DEBUG)
-        cout << "FnDecl" << endl;
-    Node::S->enterScope();
+/* The initializer is resolved first, so "float x = x;" reads an outer x.
+ * Only level 1 (the program scope) holds globals; their initializers must
+ * be constant, as there is no code to compute them in. A const is bound
+ * to its initializer's value, so that must be constant too. A const
+ * formal is only read-only; every other const needs an initializer.
+ */
+void VarDecl::Resolve() {
+    bool global = Node::S->getLevelNumber() == 1;
+    if (constant && !init && dynamic_cast<FnDecl*>(GetParent()) == NULL)
+        ReportError::Formatted(GetLocation(),
+            "Const variable '%s' must be initialized", getId());
+    if (init) {
+        init->Resolve();
+        Type *t = init->getType();
+        if (t != Type::errorType && !t->IsConvertibleTo(type))
+            ReportError::Formatted(init->GetLocation(),
+                "Cannot initialize %s '%s' with %s", type->getName(),
+                getId(), t->getName());
+        (init = init->Simplify(precise))->SetParent(this);
+        if ((global || constant) && t != Type::errorType &&
+            !init->IsConstant())
+            ReportError::Formatted(init->GetLocation(),
+                "Initializer of %s '%s' is not a constant expression",
+                constant ? "const" : "global", getId());
+    }
+    Bind(NULL, global ? GLOBAL : LOCAL);
+    container c = { this, NULL, storage };
+    if (!Node::S->insert(make_pair(string(getId()), c)))
+        ReportError::Formatted(GetLocation(),
+            "'%s' is already declared in this scope", getId());
+}
+
+/* Uninitialized globals are the shader's inputs, set by the host. One
+ * that has an initializer and is never written keeps that value for good,
+ * so it is emitted as an internal constant that loads fold through.
+ */
+bool VarDecl::IsReadOnly() {
+    return storage == GLOBAL && init && !IsWritten();
+}
+
+/* The global, or the value of a const, in the current module. Internal
+ * globals do not link by name, so each module gets its own copy.
+ */
+llvm::Value* VarDecl::Import() {
     llvm::Module *mod = Node::irgen->GetOrCreateModule("mod");
-    string name = getId();
+    llvm::Type *t = type->convert();
+    if (storage == CONSTANT)
+        return Node::irgen->CreateConversion(init->Emit(), t);
+    if (llvm::GlobalVariable *g = mod->getGlobalVariable(getId(), true))
+        return g;
+    if (IsReadOnly()) {
+        llvm::Constant *initC = llvm::dyn_cast<llvm::Constant>(
+            Node::irgen->CreateConversion(init->Emit(), t));
+        if (initC == NULL)
+            initC = llvm::Constant::getNullValue(t);
+        return new llvm::GlobalVariable(*mod, t, true,
+            llvm::GlobalValue::InternalLinkage, initC, getId());
+    }
+    return new llvm::GlobalVariable(*mod, t, false,
+        llvm::GlobalValue::ExternalLinkage, NULL, getId());
+}
+
+llvm::FunctionType* FnDecl::GetFunctionType() {
     llvm::Type* retType = returnType->convert();
     vector<llvm::Type *> argTypes;
     for (int i = 0; i < formals->NumElements(); i++) {
-        argTypes.push_back(formals->Nth(i)->getType()->convert());
+        llvm::Type* t = formals->Nth(i)->getType()->convert();
+        if (formals->Nth(i)->IsByReference())
+            t = llvm::PointerType::getUnqual(t);
+        argTypes.push_back(t);
     }
     llvm::ArrayRef<llvm::Type *> argArray(argTypes);
-    llvm::FunctionType *funcTy = llvm::FunctionType::get(retType, argArray, false);
-    llvm::Function *f = llvm::cast<llvm::Function>(mod->getOrInsertFunction(name, funcTy));
+    return llvm::FunctionType::get(retType, argArray, false);
+}
+
+llvm::Value* FnDecl::Import() {
+    llvm::Module *mod = Node::irgen->GetOrCreateModule("mod");
+    return mod->getOrInsertFunction(getId(), GetFunctionType());
+}
+
+llvm::Value* FnDecl::Emit() {
+    TRACE(TraceEmit, "FnDecl");
+    llvm::Function *f = EmitPrototype();
+    if (body)
+        EmitBody(f);
+    return NULL;
+}
+
+// a prototype and its definition share the global entry
+llvm::Function* FnDecl::EmitPrototype() {
+    llvm::Module *mod = Node::irgen->GetOrCreateModule("mod");
+    llvm::Function *f = llvm::cast<llvm::Function>(
+        mod->getOrInsertFunction(getId(), GetFunctionType()));
+    Bind(f, GLOBAL);
+    return f;
+}
+
+void FnDecl::EmitBody(llvm::Function *f) {
+    string name = getId();
     Node::irgen->SetFunction(f);
     llvm::LLVMContext *context = Node::irgen->GetContext();
     llvm::BasicBlock *bb = llvm::BasicBlock::Create(*context, name, f);
@@ -72,25 +173,99 @@ llvm::Value* FnDecl::Emit() {
     int i = 0;
     for (llvm::Function::arg_iterator arg = f->arg_begin(); 
          arg != f->arg_end(); arg++, i++) {
-        formals->Nth(i)->Emit();
-        string varname = formals->Nth(i)->getId();
+        VarDecl *formal = formals->Nth(i);
+        string varname = formal->getId();
         arg->setName(varname);
-        container c = Node::S->find(varname);
         llvm::Value *v = &*arg;
-        new llvm::StoreInst(v, c.val, bb);
+        if (formal->IsByReference()) {
+            // out/inout formals use the caller's storage directly
+            formal->Bind(v, LOCAL);
+            continue;
+        }
+        formal->Emit();
+        new llvm::StoreInst(v, formal->getSlot(), bb);
     }
     body->Emit();
+    Node::irgen->FinishFunction();
+    Node::irgen->InlineCalls();
+}
+
+/* The function is visible before its body so recursive calls resolve; a
+ * prototype and its definition may share the name. Formals and the
+ * outermost block of the body form one scope.
+ */
+void FnDecl::Resolve() {
+    Declare();
+    if (body)
+        ResolveBody();
+}
+
+/* Calls bind to the first declaration of a name, so a later prototype or
+ * definition must agree with it, and only one of them may have a body.
+ */
+void FnDecl::Declare() {
+    container c = { this, NULL, GLOBAL };
+    FnDecl *first = this;
+    if (!Node::S->insert(make_pair(string(getId()), c))) {
+        first = dynamic_cast<FnDecl*>(Node::S->find(getId()).decl);
+        if (!first) {
+            ReportError::Formatted(GetLocation(),
+                "'%s' is already declared in this scope", getId());
+            return;
+        }
+        if (!first->Matches(this)) {
+            ReportError::Formatted(GetLocation(),
+                "Declaration of '%s' does not match its prototype", getId());
+            return;
+        }
+    }
+    if (!body)
+        return;
+    if (first->defined)
+        ReportError::Formatted(GetLocation(),
+            "Redefinition of function '%s'", getId());
+    first->defined = true;
+}
+
+// same return type and formals, qualifiers included
+bool FnDecl::Matches(FnDecl *other) {
+    if (returnType != other->returnType ||
+        formals->NumElements() != other->formals->NumElements())
+        return false;
+    for (int i = 0; i < formals->NumElements(); i++) {
+        VarDecl *a = formals->Nth(i), *b = other->formals->Nth(i);
+        if (a->getType() != b->getType() ||
+            a->getQualifier() != b->getQualifier())
+            return false;
+    }
+    return true;
+}
+
+void FnDecl::ResolveBody() {
+    Node::S->enterScope();
+    for (int i = 0; i < formals->NumElements(); i++)
+        formals->Nth(i)->Resolve();
+    body->Resolve();
     Node::S->exitScope();
-    return NULL;
 }
 VarDecl::VarDecl(Identifier *n, Type *t) : Decl(n) {
     Assert(n != NULL && t != NULL);
     (type=t)->SetParent(this);
+    qualifier = NoQualifier;
+    init = NULL;
+    precise = false;
+    constant = false;
+    written = false;
+}
+
+void VarDecl::SetInitializer(Expr *e) {
+    (init=e)->SetParent(this);
 }
   
 void VarDecl::PrintChildren(int indentLevel) { 
    if (type) type->Print(indentLevel+1);
    if (id) id->Print(indentLevel+1);
+   if (init) init->Print(indentLevel+1, "(init) ");
 }
 
 
@@ -99,6 +274,7 @@ FnDecl::FnDecl(Identifier *n, Type *r, List<VarDecl*> *d) : Decl(n) {
     (returnType=r)->SetParent(this);
     (formals=d)->SetParentAll(this);
     body = NULL;
+    defined = false;
 }
 
 void FnDecl::SetFunctionBody(Stmt *b) { 
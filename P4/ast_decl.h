@@ -17,24 +17,48 @@
 #include "ast.h"
 #include "list.h"
 #include "ast_type.h"
+#include <atomic>
 
 class Type;
 class NamedType;
 class Identifier;
 class Stmt;
+class Expr;
 
 void yyerror(const char *msg);
 
+// Parameter qualifiers. out and inout formals are passed by pointer so
+// the callee writes straight into the caller's storage.
+typedef enum {
+    NoQualifier,
+    InQualifier,
+    OutQualifier,
+    InoutQualifier
+} TypeQualifier;
+
 class Decl : public Node 
 {
   protected:
     Identifier *id;
+    llvm::Value *slot;	// alloca, global or function once emitted
+    int storage;	// GLOBAL, LOCAL or CONSTANT (slot is the value)
   
   public:
-    Decl() : id(NULL) {}
+    Decl() : id(NULL), slot(NULL), storage(INVALID) {}
     Decl(Identifier *name);
     const char* getId() { return id->getName(); }
     Identifier *GetIdentifier() const { return id; }
+    // a worker emitting into its own context gets its module's
+    // declaration of a global or function instead of the main one
+    llvm::Value *getSlot() {
+        if ((storage == GLOBAL || storage == CONSTANT) && slot &&
+            &slot->getContext() != Node::irgen->GetContext())
+            return Import();
+        return slot;
+    }
+    virtual llvm::Value *Import() { return slot; }
+    int getStorage() { return storage; }
+    void Bind(llvm::Value *v, int flag) { slot = v; storage = flag; }
     llvm::Value* Emit();
 };
 
@@ -42,13 +66,34 @@ class VarDecl : public Decl
 {
   protected:
     Type *type;
+    TypeQualifier qualifier;
+    Expr *init;	// NULL if not initialized
+    bool precise;	// no fast-math flags or contraction on its updates
+    bool constant;	// const: bound to the value of its initializer
+    std::atomic<bool> written;	// assigned or passed as out/inout anywhere
     
   public:
-    VarDecl() : type(NULL) {}
+    VarDecl() : type(NULL), qualifier(NoQualifier), init(NULL),
+                precise(false), constant(false), written(false) {}
     VarDecl(Identifier *name, Type *type);
     const char *GetPrintNameForNode() { return "VarDecl"; }
     Type* getType() { return type; }
+    TypeQualifier getQualifier() { return qualifier; }
+    void SetQualifier(TypeQualifier q) { qualifier = q; }
+    void SetInitializer(Expr *e);
+    Expr *getInit() { return init; }
+    bool IsPrecise() { return precise; }
+    void SetPrecise(bool p) { precise = p; }
+    bool IsConst() { return constant; }
+    void SetConst(bool c) { constant = c; }
+    bool IsWritten() { return written; }
+    void SetWritten() { written = true; }
+    bool IsByReference() { return qualifier == OutQualifier ||
+                                  qualifier == InoutQualifier; }
+    bool IsReadOnly();
     llvm::Value* Emit();
+    llvm::Value *Import();
+    void Resolve();
     void PrintChildren(int indentLevel);
 };
 
@@ -65,12 +110,25 @@ class FnDecl : public Decl
     List<VarDecl*> *formals;
     Type *returnType;
     Stmt *body;
+    bool defined;   // a body has been declared under this binding
     
   public:
-    FnDecl() : Decl(), formals(NULL), returnType(NULL), body(NULL) {}
+    FnDecl() : Decl(), formals(NULL), returnType(NULL), body(NULL),
+               defined(false) {}
     FnDecl(Identifier *name, Type *returnType, List<VarDecl*> *formals);
     llvm::Value* Emit();
+    llvm::Function *EmitPrototype();
+    void EmitBody(llvm::Function *f);
+    llvm::FunctionType *GetFunctionType();
+    llvm::Value *Import();
+    void Resolve();
+    void Declare();
+    bool Matches(FnDecl *other);
+    void ResolveBody();
     void SetFunctionBody(Stmt *b);
+    List<VarDecl*> *getFormals() { return formals; }
+    Type *getReturnType() { return returnType; }
+    Stmt *getBody() { return body; }
     const char *GetPrintNameForNode() { return "FnDecl"; }
     void PrintChildren(int indentLevel);
 };
@@ -3,10 +3,74 @@
  * Implementation of expression node classes.
  */
 
+#include <limits.h>
 #include <string.h>
+#include <cmath>
 #include "ast_expr.h"
 #include "ast_type.h"
 #include "ast_decl.h"
+#include "errors.h"
+
+/* Type checking
+ * -------------
+ * Resolve() also gives every expression its static type (getType()),
+ * built from the already resolved operands, and reports misuse. An
+ * operand of errorType yields errorType without a further report, so
+ * one mistake produces one message.
+ */
+
+// NULL (parse errors, empty expressions) reads as errorType
+static Type* TypeOf(Expr* e) {
+  Type* t = e ? e->getType() : NULL;
+  return t ? t : Type::errorType;
+}
+
+// result of lhs oper rhs for + - * /, NULL if the operands do not mix
+static Type* ArithType(Type* l, Type* r, const char* oper) {
+  if( l == r ) {
+    return l->IsNumeric() ? l : NULL;
+  }
+  if( l == Type::floatType && (r->IsVector() || r->IsMatrix()) ) {
+    return r;
+  }
+  if( r == Type::floatType && (l->IsVector() || l->IsMatrix()) ) {
+    return l;
+  }
+  if( strcmp(oper, "*") == 0 && l->Size() == r->Size() ) {
+    //mat*vec and vec*mat are vectors
+    if( l->IsMatrix() && r->IsVector() ) {
+      return r;
+    }
+    if( l->IsVector() && r->IsMatrix() ) {
+      return l;
+    }
+  }
+  return NULL;
+}
+
+// the variable an assignment to e writes, through any swizzles
+static VarDecl* TargetOf(Expr* e) {
+  while( FieldAccess* f = dynamic_cast<FieldAccess*>(e) ) {
+    e = f->getBase();
+  }
+  VarExpr* v = dynamic_cast<VarExpr*>(e);
+  return v ? dynamic_cast<VarDecl*>(v->getDecl()) : NULL;
+}
+
+// records that target is written; false after reporting a const one
+static bool MarkWritten(Expr* target) {
+  VarDecl* d = TargetOf(target);
+  if( d == NULL ) {
+    return true;
+  }
+  if( d->IsConst() ) {
+    ReportError::Formatted(target->GetLocation(),
+		"Cannot modify const variable '%s'", d->getId());
+    return false;
+  }
+  d->SetWritten();
+  return true;
+}
 
 llvm::Value* Expr::Emit() {
   return NULL;
@@ -23,16 +87,15 @@ llvm::Value* EmptyExpr::Emit() {
 }
 
 llvm::Value* IntConstant::Emit() {
-  if( DEBUG ) {
-    printf("Int\n");
-  }
+  TRACE(TraceEmit, "Int");
   llvm::Type* iConst = irgen->IRGenerator::GetIntType();
   llvm::Value* result = llvm::ConstantInt::get(iConst, value);
   return result;
 }
 
-IntConstant::IntConstant(yyltype loc, int val) : Expr(loc) {
+IntConstant::IntConstant(SourceRange loc, int val) : Expr(loc) {
     value = val;
+    staticType = Type::intType;
 }
 
 void IntConstant::PrintChildren(int indentLevel) { 
@@ -40,33 +103,31 @@ void IntConstant::PrintChildren(int indentLevel) {
 }
 
 llvm::Value* FloatConstant::Emit() {
-  if( DEBUG ) {
-    printf("Float\n");
-  }
+  TRACE(TraceEmit, "Float");
   llvm::Type* fConst = irgen->IRGenerator::GetFloatType();
   llvm::Value* result = llvm::ConstantFP::get(fConst, value);
   return result;
 }
 
 
-FloatConstant::FloatConstant(yyltype loc, double val) : Expr(loc) {
+FloatConstant::FloatConstant(SourceRange loc, double val) : Expr(loc) {
     value = val;
+    staticType = Type::floatType;
 }
 void FloatConstant::PrintChildren(int indentLevel) { 
     printf("%g", value);
 }
 
 llvm::Value* BoolConstant::Emit() {
-  if( DEBUG ) {
-    printf("Bool\n");
-  }
+  TRACE(TraceEmit, "Bool");
   llvm::Type* bConst = irgen->IRGenerator::GetBoolType();
   llvm::Value* result = llvm::ConstantInt::get(bConst, value);
   return result;
 }
 
-BoolConstant::BoolConstant(yyltype loc, bool val) : Expr(loc) {
+BoolConstant::BoolConstant(SourceRange loc, bool val) : Expr(loc) {
     value = val;
+    staticType = Type::boolType;
 }
 void BoolConstant::PrintChildren(int indentLevel) { 
     printf("%s", value ? "true" : "false");
@@ -75,31 +136,39 @@ void BoolConstant::PrintChildren(int indentLevel) {
 VarExpr::VarExpr(yyltype loc, Identifier *ident) : Expr(loc) {
     Assert(ident != NULL);
     this->id = ident;
+    decl = NULL;
+}
+
+void VarExpr::Resolve() {
+  decl = S->find(id->getName()).decl;
+  staticType = Type::errorType;
+  if( decl == NULL ) {
+    ReportError::Formatted(GetLocation(), "'%s' was not declared in this scope",
+		id->getName());
+  } else if( VarDecl* v = dynamic_cast<VarDecl*>(decl) ) {
+    staticType = v->getType();
+  } else {
+    ReportError::Formatted(GetLocation(), "'%s' is a function, not a variable",
+		id->getName());
+  }
 }
 
 llvm::Value* VarExpr::Emit() {
-  if( DEBUG ) {
-    printf("VarExpr\n");
-  }
-  /*
-  container c = Node::S->find(id->getName());
-  if (c.flag == GLOBAL)
-      return new llvm::LoadInst(c.val, id->getName(), Node::irgen->GetBasicBlock());
-  else if (c.flag == LOCAL)
-      return c.val;
-  */
-  llvm::Value* mem = S->find(id->getName()).val;
+  TRACE(TraceEmit, "VarExpr");
+  if( decl->getStorage() == CONSTANT ) {
+    //bound to a known value, e.g. an unrolled loop index
+    return decl->getSlot();
+  }
+  llvm::Value* mem = decl->getSlot();
   llvm::Value* result = new llvm::LoadInst(mem, id->getName(), 
 		irgen->IRGenerator::GetBasicBlock());
   return result;
 }
 
 llvm::Value* VarExpr::EmitAddress() {
-  if( DEBUG ) {
-    printf("VarExpr EmitAddress\n");
-  }
+  TRACE(TraceEmit, "VarExpr EmitAddress");
    
-  llvm::Value* mem = S->find(id->getName()).val;
+  llvm::Value* mem = decl->getSlot();
   return mem;
 }
 
@@ -143,6 +212,486 @@ CompoundExpr::CompoundExpr(Expr *l, Operator *o)
     (op=o)->SetParent(this);
 }
 
+void CompoundExpr::Resolve() {
+  if( left ) {
+    left->Resolve();
+  }
+  if( right ) {
+    right->Resolve();
+  }
+  staticType = Check();
+}
+
+Type* ArithmeticExpr::Check() {
+  Type* r = TypeOf(right);
+  if( left == NULL ) {
+    //unary + - ++ --
+    char* oper = op->getOp();
+    if( (strcmp(oper, "++") == 0 || strcmp(oper, "--") == 0) &&
+	!MarkWritten(right) ) {
+      return Type::errorType;
+    }
+    if( r == Type::errorType || r->IsNumeric() ) {
+      return r;
+    }
+    ReportError::IncompatibleOperand(op, r);
+    return Type::errorType;
+  }
+  Type* l = TypeOf(left);
+  if( l == Type::errorType || r == Type::errorType ) {
+    return Type::errorType;
+  }
+  Type* t = ArithType(l, r, op->getOp());
+  if( t == NULL ) {
+    ReportError::IncompatibleOperands(op, l, r);
+    return Type::errorType;
+  }
+  return t;
+}
+
+Type* RelationalExpr::Check() {
+  Type* l = TypeOf(left);
+  Type* r = TypeOf(right);
+  if( l == Type::errorType || r == Type::errorType ) {
+    return Type::errorType;
+  }
+  if( l == r && (l == Type::intType || l == Type::floatType) ) {
+    return Type::boolType;
+  }
+  ReportError::IncompatibleOperands(op, l, r);
+  return Type::errorType;
+}
+
+Type* EqualityExpr::Check() {
+  Type* l = TypeOf(left);
+  Type* r = TypeOf(right);
+  if( l == Type::errorType || r == Type::errorType ) {
+    return Type::errorType;
+  }
+  if( l == r && l != Type::voidType ) {
+    return Type::boolType;
+  }
+  ReportError::IncompatibleOperands(op, l, r);
+  return Type::errorType;
+}
+
+Type* LogicalExpr::Check() {
+  Type* r = TypeOf(right);
+  if( left == NULL ) {
+    if( r == Type::errorType || r == Type::boolType ) {
+      return r;
+    }
+    ReportError::IncompatibleOperand(op, r);
+    return Type::errorType;
+  }
+  Type* l = TypeOf(left);
+  if( l == Type::errorType || r == Type::errorType ) {
+    return Type::errorType;
+  }
+  if( l == Type::boolType && r == Type::boolType ) {
+    return Type::boolType;
+  }
+  ReportError::IncompatibleOperands(op, l, r);
+  return Type::errorType;
+}
+
+/* Plain assignment needs matching types, except that a swizzle target
+ * takes a float in every lane. a op= b must have a op b of a's type.
+ */
+Type* AssignExpr::Check() {
+  Type* l = TypeOf(left);
+  Type* r = TypeOf(right);
+  if( l == Type::errorType || r == Type::errorType ) {
+    return Type::errorType;
+  }
+  char* oper = op->getOp();
+  bool swizzle = dynamic_cast<FieldAccess*>(left) != NULL;
+  if( !swizzle && dynamic_cast<VarExpr*>(left) == NULL ) {
+    ReportError::Formatted(left->GetLocation(),
+		"Left side of '%s' is not assignable", oper);
+    return Type::errorType;
+  }
+  if( !MarkWritten(left) ) {
+    return Type::errorType;
+  }
+  if( strcmp(oper, "=") == 0 ) {
+    if( l == r || (swizzle && l->IsVector() && r == Type::floatType) ) {
+      return l;
+    }
+  } else {
+    char arith[2] = { oper[0], '\0' };
+    if( ArithType(l, r, arith) == l ) {
+      return l;
+    }
+  }
+  ReportError::IncompatibleOperands(op, l, r);
+  return Type::errorType;
+}
+
+Type* PostfixExpr::Check() {
+  Type* l = TypeOf(left);
+  if( !MarkWritten(left) ) {
+    return Type::errorType;
+  }
+  if( l == Type::errorType || l->IsNumeric() ) {
+    return l;
+  }
+  ReportError::IncompatibleOperand(op, l);
+  return Type::errorType;
+}
+
+/* Simplification
+ * --------------
+ * Simplify() runs once per statement after Resolve() and replaces
+ * constant subtrees of int, float, bool and float vector type by their
+ * value, and drops operations that cannot change their operand. Folding
+ * uses the arithmetic the emitted code would: 32-bit wraparound for int
+ * and float precision for float. x + 0.0 turns -0.0 into +0.0, so it is
+ * only removed under -ffast-math or -fnsz, and never inside precise.
+ */
+
+// the lanes of a float constant or of a float vector constructor whose
+// arguments are all scalar constants; a single argument fills every lane
+static bool FloatLanes(Expr* e, std::vector<float>& lanes) {
+  lanes.clear();
+  if( FloatConstant* f = dynamic_cast<FloatConstant*>(e) ) {
+    lanes.push_back(f->getValue());
+    return true;
+  }
+  ConstructorExpr* c = dynamic_cast<ConstructorExpr*>(e);
+  if( c == NULL || !c->getType()->IsVector() ) {
+    return false;
+  }
+  List<Expr*>* args = c->getArgs();
+  for( int i = 0; i < args->NumElements(); ++i ) {
+    if( FloatConstant* f = dynamic_cast<FloatConstant*>(args->Nth(i)) ) {
+      lanes.push_back(f->getValue());
+    } else if( IntConstant* n = dynamic_cast<IntConstant*>(args->Nth(i)) ) {
+      lanes.push_back(n->getValue());
+    } else {
+      return false;
+    }
+  }
+  int size = c->getType()->Size();
+  if( lanes.size() == 1 ) {
+    lanes.assign(size, lanes[0]);
+  }
+  return (int)lanes.size() == size;
+}
+
+// a float constant, or a vecN constructor of one per lane
+static Expr* MakeFloats(SourceRange loc, Type* type,
+		const std::vector<float>& lanes) {
+  if( type == Type::floatType ) {
+    return new FloatConstant(loc, lanes[0]);
+  }
+  List<Expr*>* args = new List<Expr*>;
+  for( size_t i = 0; i < lanes.size(); ++i ) {
+    args->Append(new FloatConstant(loc, lanes[i]));
+  }
+  ConstructorExpr* c = new ConstructorExpr(loc, type, args);
+  c->Resolve();
+  return c;
+}
+
+// every lane of e is k; the sign of a zero only matters if !anySign
+static bool AllLanes(Expr* e, float k, bool anySign) {
+  std::vector<float> lanes;
+  if( !FloatLanes(e, lanes) ) {
+    return false;
+  }
+  for( size_t i = 0; i < lanes.size(); ++i ) {
+    if( lanes[i] != k ||
+	(!anySign && std::signbit(lanes[i]) != std::signbit(k)) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool IsInt(Expr* e, int k) {
+  IntConstant* n = dynamic_cast<IntConstant*>(e);
+  return n != NULL && n->getValue() == k;
+}
+
+static bool IsBool(Expr* e, bool k) {
+  BoolConstant* b = dynamic_cast<BoolConstant*>(e);
+  return b != NULL && b->getValue() == k;
+}
+
+// lhs oper rhs as the emitted code computes it; false for a division
+// that would trap
+static bool FoldInt(int lhs, int rhs, const char* oper, int* result) {
+  unsigned l = lhs, r = rhs;
+  if( strcmp(oper, "+") == 0 ) {
+    *result = (int)(l + r);
+  } else if( strcmp(oper, "-") == 0 ) {
+    *result = (int)(l - r);
+  } else if( strcmp(oper, "*") == 0 ) {
+    *result = (int)(l * r);
+  } else {
+    if( rhs == 0 || (lhs == INT_MIN && rhs == -1) ) {
+      return false;
+    }
+    *result = lhs / rhs;
+  }
+  return true;
+}
+
+static float FoldFloat(float lhs, float rhs, const char* oper) {
+  if( strcmp(oper, "+") == 0 ) {
+    return lhs + rhs;
+  } else if( strcmp(oper, "-") == 0 ) {
+    return lhs - rhs;
+  } else if( strcmp(oper, "*") == 0 ) {
+    return lhs * rhs;
+  }
+  return lhs / rhs;
+}
+
+// replaces every element of list by its simplified form
+static void SimplifyList(List<Expr*>* list, Node* parent, bool exact) {
+  for( int i = 0; i < list->NumElements(); ++i ) {
+    Expr* e = list->Nth(i)->Simplify(exact);
+    if( e != list->Nth(i) ) {
+      list->RemoveAt(i);
+      list->InsertAt(e, i);
+      e->SetParent(parent);
+    }
+  }
+}
+
+Expr* CompoundExpr::Simplify(bool exact) {
+  if( left ) {
+    (left = left->Simplify(exact))->SetParent(this);
+  }
+  if( right ) {
+    (right = right->Simplify(exact))->SetParent(this);
+  }
+  return this;
+}
+
+Expr* ArithmeticExpr::Simplify(bool exact) {
+  CompoundExpr::Simplify(exact);
+  if( staticType == NULL || staticType == Type::errorType ) {
+    return this;
+  }
+  char* oper = op->getOp();
+  std::vector<float> l, r;
+  if( left == NULL ) {
+    if( strcmp(oper, "+") == 0 ) {
+      return right;
+    }
+    if( strcmp(oper, "-") != 0 ) {
+      //++ and -- write their operand
+      return this;
+    }
+    if( IntConstant* n = dynamic_cast<IntConstant*>(right) ) {
+      return new IntConstant(GetLocation(), (int)(0u - n->getValue()));
+    }
+    if( FloatLanes(right, r) ) {
+      for( size_t i = 0; i < r.size(); ++i ) {
+        r[i] = -r[i];
+      }
+      return MakeFloats(GetLocation(), staticType, r);
+    }
+    ArithmeticExpr* inner = dynamic_cast<ArithmeticExpr*>(right);
+    if( inner && inner->left == NULL && strcmp(inner->op->getOp(), "-") == 0 ) {
+      return inner->right;
+    }
+    return this;
+  }
+
+  IntConstant* li = dynamic_cast<IntConstant*>(left);
+  IntConstant* ri = dynamic_cast<IntConstant*>(right);
+  int value;
+  if( li && ri && FoldInt(li->getValue(), ri->getValue(), oper, &value) ) {
+    return new IntConstant(GetLocation(), value);
+  }
+  bool add = strcmp(oper, "+") == 0, mul = strcmp(oper, "*") == 0;
+  if( staticType == Type::intType ) {
+    //x+0, x-0, x*1, x/1, 0+x and 1*x
+    int unit = (add || strcmp(oper, "-") == 0) ? 0 : 1;
+    if( IsInt(right, unit) ) {
+      return left;
+    }
+    if( (add || mul) && IsInt(left, unit) ) {
+      return right;
+    }
+    return this;
+  }
+
+  if( FloatLanes(left, l) && FloatLanes(right, r) ) {
+    //lane-wise, a scalar operand is used for every lane
+    size_t n = l.size() > r.size() ? l.size() : r.size();
+    std::vector<float> result(n);
+    for( size_t i = 0; i < n; ++i ) {
+      result[i] = FoldFloat(l[l.size() == 1 ? 0 : i],
+			    r[r.size() == 1 ? 0 : i], oper);
+    }
+    return MakeFloats(GetLocation(), staticType, result);
+  }
+
+  //x*1, 1*x, x/1, x-(+0) and x+(-0) are x, bit for bit
+  bool anySign = !exact && (IsOptionOn("fast-math") || IsOptionOn("nsz"));
+  Expr* kept = NULL;
+  if( mul ) {
+    if( AllLanes(right, 1.0f, false) ) {
+      kept = left;
+    } else if( AllLanes(left, 1.0f, false) ) {
+      kept = right;
+    }
+  } else if( strcmp(oper, "/") == 0 ) {
+    if( AllLanes(right, 1.0f, false) ) {
+      kept = left;
+    }
+  } else if( strcmp(oper, "-") == 0 ) {
+    if( AllLanes(right, 0.0f, anySign) ) {
+      kept = left;
+    }
+  } else if( AllLanes(right, -0.0f, anySign) ) {
+    kept = left;
+  } else if( AllLanes(left, -0.0f, anySign) ) {
+    kept = right;
+  }
+  //a scalar operand does not stand in for a vector result
+  if( kept && kept->getType() == staticType ) {
+    return kept;
+  }
+  return this;
+}
+
+Expr* RelationalExpr::Simplify(bool exact) {
+  CompoundExpr::Simplify(exact);
+  char* oper = op->getOp();
+  IntConstant* li = dynamic_cast<IntConstant*>(left);
+  IntConstant* ri = dynamic_cast<IntConstant*>(right);
+  FloatConstant* lf = dynamic_cast<FloatConstant*>(left);
+  FloatConstant* rf = dynamic_cast<FloatConstant*>(right);
+  if( li && ri ) {
+    int a = li->getValue(), b = ri->getValue();
+    bool result = strcmp(oper, "<") == 0 ? a < b :
+		  strcmp(oper, ">") == 0 ? a > b :
+		  strcmp(oper, "<=") == 0 ? a <= b : a >= b;
+    return new BoolConstant(GetLocation(), result);
+  }
+  if( lf && rf ) {
+    //ordered compares, false if either side is NaN
+    float l = lf->getValue(), r = rf->getValue();
+    bool result = strcmp(oper, "<") == 0 ? l < r :
+		  strcmp(oper, ">") == 0 ? l > r :
+		  strcmp(oper, "<=") == 0 ? l <= r : l >= r;
+    return new BoolConstant(GetLocation(), result);
+  }
+  return this;
+}
+
+Expr* EqualityExpr::Simplify(bool exact) {
+  CompoundExpr::Simplify(exact);
+  bool equal = strcmp(op->getOp(), "==") == 0;
+  IntConstant* li = dynamic_cast<IntConstant*>(left);
+  IntConstant* ri = dynamic_cast<IntConstant*>(right);
+  FloatConstant* lf = dynamic_cast<FloatConstant*>(left);
+  FloatConstant* rf = dynamic_cast<FloatConstant*>(right);
+  BoolConstant* lb = dynamic_cast<BoolConstant*>(left);
+  BoolConstant* rb = dynamic_cast<BoolConstant*>(right);
+  if( li && ri ) {
+    bool same = li->getValue() == ri->getValue();
+    return new BoolConstant(GetLocation(), same == equal);
+  }
+  if( lb && rb ) {
+    bool same = lb->getValue() == rb->getValue();
+    return new BoolConstant(GetLocation(), same == equal);
+  }
+  if( lf && rf ) {
+    //== is ordered and != is FCMP_ONE, so both are false for NaN
+    float l = lf->getValue(), r = rf->getValue();
+    return new BoolConstant(GetLocation(), equal ? l == r : (l < r || l > r));
+  }
+  return this;
+}
+
+/* && and || short-circuit in GLSL, so a constant left side may drop the
+ * right one; a constant right side only drops itself.
+ */
+Expr* LogicalExpr::Simplify(bool exact) {
+  CompoundExpr::Simplify(exact);
+  if( left == NULL || staticType != Type::boolType ) {
+    return this;
+  }
+  //true for &&, false for ||
+  bool unit = strcmp(op->getOp(), "&&") == 0;
+  if( IsBool(left, unit) ) {
+    return right;
+  }
+  if( IsBool(right, unit) || IsBool(left, !unit) ) {
+    //b && true, b || false; false && b, true || b
+    return left;
+  }
+  return this;
+}
+
+/* A read of a const whose initializer folded to a literal becomes a copy
+ * of the literal, so it folds further with its neighbours.
+ */
+Expr* VarExpr::Simplify(bool exact) {
+  VarDecl* v = dynamic_cast<VarDecl*>(decl);
+  if( v == NULL || !v->IsConst() || v->getInit() == NULL ) {
+    return this;
+  }
+  Expr* init = v->getInit();
+  std::vector<float> lanes;
+  if( TypeOf(init) != staticType ) {
+    //converted when emitted
+    return this;
+  } else if( IntConstant* n = dynamic_cast<IntConstant*>(init) ) {
+    return new IntConstant(GetLocation(), n->getValue());
+  } else if( BoolConstant* b = dynamic_cast<BoolConstant*>(init) ) {
+    return new BoolConstant(GetLocation(), b->getValue());
+  } else if( FloatLanes(init, lanes) ) {
+    return MakeFloats(GetLocation(), staticType, lanes);
+  }
+  return this;
+}
+
+// consts Simplify leaves in place, e.g. matrices, are still constant
+bool VarExpr::IsConstant() {
+  VarDecl* v = dynamic_cast<VarDecl*>(decl);
+  return v != NULL && v->IsConst() && v->getInit() != NULL &&
+	v->getInit()->IsConstant();
+}
+
+// a swizzle of a constant vector picks its lanes
+Expr* FieldAccess::Simplify(bool exact) {
+  if( base == NULL ) {
+    return this;
+  }
+  (base = base->Simplify(exact))->SetParent(this);
+  std::vector<float> lanes, picked;
+  if( staticType == NULL || staticType == Type::errorType ||
+	!TypeOf(base)->IsVector() || !FloatLanes(base, lanes) ) {
+    return this;
+  }
+  for( const char* c = field->getName(); *c != '\0'; ++c ) {
+    picked.push_back(lanes[SwizzleIndex(*c)]);
+  }
+  return MakeFloats(GetLocation(), staticType, picked);
+}
+
+Expr* AssignExpr::Simplify(bool exact) {
+  return CompoundExpr::Simplify(exact || IsPrecise());
+}
+
+Expr* Call::Simplify(bool exact) {
+  SimplifyList(actuals, this, exact);
+  return this;
+}
+
+Expr* ConstructorExpr::Simplify(bool exact) {
+  SimplifyList(args, this, exact);
+  return this;
+}
+
 void CompoundExpr::PrintChildren(int indentLevel) {
    if (left) left->Print(indentLevel+1);
    op->Print(indentLevel+1);
@@ -152,72 +701,34 @@ void CompoundExpr::PrintChildren(int indentLevel) {
 llvm::Value* ArithmeticExpr::Emit() {
   if( left == NULL ) {
     //Prefix expression
-    if( DEBUG ) {
-      printf("Prefix\n");
-    }
+    TRACE(TraceEmit, "Prefix");
     llvm::Value* rhs = right->Emit();
-    llvm::Value* addr;
-    const char* cSwiz = "";
+    llvm::Value* addr = NULL;
     if( VarExpr* rightV = dynamic_cast<VarExpr*>(right) ) {
       addr = rightV->EmitAddress();
-    } else if( FieldAccess* f = dynamic_cast<FieldAccess*>(right) ) {
-      addr = f->EmitAddress();
-      cSwiz = f->getId()->getName();
-    } else {
-      if( DEBUG ) printf("prefix not var or field\n");
+    } else if( dynamic_cast<FieldAccess*>(right) == NULL ) {
+      TRACE(TraceEmit, "prefix not var or field");
       addr = right->Emit();
     }
     
-    llvm::Type* rType = rhs->getType();
+    Type* rt = right->getType();
     char* oper = op->getOp();
-    if( strlen(cSwiz) != 0 ) {
-      //field assignment
-      llvm::Constant* inc = llvm::ConstantFP::get(
-		irgen->IRGenerator::GetFloatType(), 1.0);
-      llvm::Value* baseAddr = new llvm::LoadInst(addr, "",
-                irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-        char c = cSwiz[i];
-        if( c == 'x' ) {
-          vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-        } else if( c == 'y' ) {
-          vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-        } else if( c == 'z' ) {
-          vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-        } else {
-          vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-        }
-        llvm::Value* ext = llvm::ExtractElementInst::Create(baseAddr, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        if( strcmp(oper, "++") == 0 ) {
-          llvm::Value* result = llvm::BinaryOperator::CreateFAdd(ext, inc, "",
-                irgen->IRGenerator::GetBasicBlock());
-           baseAddr = llvm::InsertElementInst::Create(baseAddr, result, vecId, 
-		"", irgen->IRGenerator::GetBasicBlock());
-        } else if( strcmp(oper, "--") == 0 ) {
-          llvm::Value* result = llvm::BinaryOperator::CreateFSub(ext, inc, "",
-                irgen->IRGenerator::GetBasicBlock());
-           baseAddr = llvm::InsertElementInst::Create(baseAddr, result, vecId, 
-		"", irgen->IRGenerator::GetBasicBlock());
-        } else if( strcmp(oper, "+") == 0 ) {
-          
-        } else if( strcmp(oper, "-") == 0 ) {
-           llvm::Value* result = llvm::BinaryOperator::CreateFNeg(ext, "",
-                irgen->IRGenerator::GetBasicBlock());
-            baseAddr = llvm::InsertElementInst::Create(baseAddr, result, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-        }
+    if( FieldAccess* f = dynamic_cast<FieldAccess*>(right) ) {
+      //swizzled operand: ++ and -- write back through the lane mask
+      llvm::Constant* one = llvm::ConstantFP::get(rhs->getType(), 1.0);
+      llvm::BasicBlock* bb = irgen->IRGenerator::GetBasicBlock();
+      if( strcmp(oper, "-") == 0 ) {
+        return llvm::BinaryOperator::CreateFNeg(rhs, "", bb);
+      } else if( strcmp(oper, "++") != 0 && strcmp(oper, "--") != 0 ) {
+        return rhs;
       }
-      llvm::Value* res = new llvm::StoreInst(baseAddr, addr, "",
-                irgen->IRGenerator::GetBasicBlock());
-        return baseAddr;
+      llvm::Value* result = oper[0] == '+'
+	? llvm::BinaryOperator::CreateFAdd(rhs, one, "", bb)
+	: llvm::BinaryOperator::CreateFSub(rhs, one, "", bb);
+      f->EmitStore(result);
+      return result;
     }
-    if( rType->isFloatTy() ) {
+    if( rt == Type::floatType ) {
       //rhs is float
       if( strcmp(oper, "++") == 0 ) {
         //Prefix increment
@@ -249,14 +760,14 @@ llvm::Value* ArithmeticExpr::Emit() {
         //shouldnt be here
         return NULL;
       }
-    } else if( rType->isIntegerTy() ) {
+    } else if( rt == Type::intType ) {
       //rhs is integer
       if( strcmp(oper, "++") == 0 ) {
         //Prefix increment
         llvm::Type* iConst = irgen->IRGenerator::GetIntType();
         llvm::Value* inc = llvm::ConstantInt::get(iConst, 1, true);
-        llvm::Value* result = llvm::BinaryOperator::CreateAdd(inc, rhs, "",
-		irgen->IRGenerator::GetBasicBlock());
+        llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Add, inc, rhs);
         new llvm::StoreInst(result, addr,
                 irgen->IRGenerator::GetBasicBlock());
         return result;
@@ -264,8 +775,8 @@ llvm::Value* ArithmeticExpr::Emit() {
         //Prefix decrement
         llvm::Type* iConst = irgen->IRGenerator::GetIntType();
         llvm::Value* dec = llvm::ConstantInt::get(iConst, 1, true);
-        llvm::Value* result = llvm::BinaryOperator::CreateSub(rhs, dec, "",
-                irgen->IRGenerator::GetBasicBlock());
+        llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Sub, rhs, dec);
         new llvm::StoreInst(result, addr,
                 irgen->IRGenerator::GetBasicBlock());
         return result;
@@ -274,18 +785,19 @@ llvm::Value* ArithmeticExpr::Emit() {
         return rhs;
       } else if( strcmp(oper, "-") == 0 ) {
         //Neg
-        llvm::Value* result = llvm::BinaryOperator::CreateNeg(rhs, "",
-                irgen->IRGenerator::GetBasicBlock());
+        llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Sub,
+		llvm::Constant::getNullValue(rhs->getType()), rhs);
         return result;
       
       } else {
         //shouldn't be here
         return NULL;
       }
-    } else if( rType->isVectorTy() ) {
+    } else if( rt->IsVector() ) {
       //rhs is vector
       std::vector<llvm::Constant*> fVec;
-      llvm::VectorType* vec = (llvm::VectorType*) rType;
+      llvm::VectorType* vec = (llvm::VectorType*) rhs->getType();
       llvm::Constant* fl1 = llvm::ConstantFP::get(
                 irgen->IRGenerator::GetFloatType(), 1.0);
       llvm::Constant* fl2 = llvm::ConstantFP::get(
@@ -313,7 +825,7 @@ llvm::Value* ArithmeticExpr::Emit() {
         return result;
       } else if( strcmp(oper, "--") == 0 ) {
         //prefix dec
-        llvm::Value* result = llvm::BinaryOperator::CreateFSub(vect, rhs, "",
+        llvm::Value* result = llvm::BinaryOperator::CreateFSub(rhs, vect, "",
                 irgen->IRGenerator::GetBasicBlock());
         new llvm::StoreInst(result, addr,
                 irgen->IRGenerator::GetBasicBlock());
@@ -322,115 +834,186 @@ llvm::Value* ArithmeticExpr::Emit() {
         //do nothing
         return rhs;
       } else if( strcmp(oper, "-") == 0 ) {
-        //negate
+        //negate; the operand itself is left alone
         llvm::Value* result = llvm::BinaryOperator::CreateFNeg(rhs, "",
 		irgen->IRGenerator::GetBasicBlock());
-        new llvm::StoreInst(result, addr, 
-		irgen->IRGenerator::GetBasicBlock());
         return result;
       } else {
         //shouldn't be here
       }
+    } else if( rt->IsMatrix() ) {
+      //rhs is mat2/3/4
+      llvm::Constant* one = llvm::ConstantFP::get(
+		irgen->IRGenerator::GetFloatType(), 1.0);
+      //-0.0 - x keeps the sign of zero lanes, as fneg does
+      llvm::Constant* negZero = llvm::ConstantFP::get(
+		irgen->IRGenerator::GetFloatType(), -0.0);
+      if( strcmp(oper, "++") == 0 || strcmp(oper, "--") == 0 ) {
+        llvm::Value* result = irgen->IRGenerator::CreateMatScalarOp(
+		oper[0] == '+' ? llvm::Instruction::FAdd : llvm::Instruction::FSub,
+		rhs, one, false);
+        new llvm::StoreInst(result, addr,
+		irgen->IRGenerator::GetBasicBlock());
+        return result;
+      } else if( strcmp(oper, "-") == 0 ) {
+        return irgen->IRGenerator::CreateMatScalarOp(llvm::Instruction::FSub,
+		rhs, negZero, true);
+      }
+      return rhs;
     } else {
       //shouldn't be here
     }
   } else {
     //is a normal ArithmeticExpr
-    if( DEBUG ) {
-      printf("Arithmetic\n");
+    TRACE(TraceEmit, "Arithmetic");
+    if( llvm::Value* fused = EmitContracted() ) {
+      return fused;
     }
     llvm::Value* lhs = left->Emit();
     llvm::Value* rhs = right->Emit();
-    llvm::Type* lType = lhs->getType();
-    llvm::Type* rType = rhs->getType();
-    char * oper = op->getOp();
-    if( lType == rType ) {
-      //Left and right are of same type
-      if( lType->isFloatTy() || lType->isVectorTy() ) {
-        //Left and right are floats or vec2/3/4
-         llvm::Value* result = ArithmeticExpr::fcomp(lhs, rhs, oper);
-         return result;
-      } else if( lType->isIntegerTy() ) {
-        llvm::Value* result = ArithmeticExpr::comp(lhs, rhs, oper);
-        return result;
-      }
-      /*
-      //TODO: find how to compare types (check lhs = mat2/3/4)
-      } else if( lhs->getType() == lType ) {
-      
-      }
-      */
-    } else {
-      //lhs and rhs are of different types
-      if( lType->isFloatTy() && rType->isVectorTy() ) {
-        //Lhs is float rhs is vec
-        llvm::VectorType* vec = (llvm::VectorType*) rType;
-        //VarExpr* rightV = dynamic_cast<VarExpr*>(right);
-        //llvm::Value* addr = rightV->EmitAddress();
-        for( int i = 0; i < vec->getNumElements(); ++i ) {
-          //llvm::Value* baseAddr = new llvm::LoadInst(addr, "",
-	//	irgen->IRGenerator::GetBasicBlock());
-          llvm::Constant* vecId = 
-		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* val = llvm::ExtractElementInst::Create(rhs, vecId, "",
+    return ArithmeticExpr::binop(lhs, rhs, left->getType(), right->getType(),
+	op->getOp());
+  }
+  return NULL;
+}
+
+/* Binary arithmetic on already emitted operands of static types l and r. */
+llvm::Value* ArithmeticExpr::binop(llvm::Value* lhs, llvm::Value* rhs,
+	Type* l, Type* r, char* oper) {
+  if( l->IsMatrix() || r->IsMatrix() ) {
+    //mat2/3/4 on either side, lowered column by column
+    return ArithmeticExpr::mcomp(lhs, rhs, l, r, oper);
+  }
+  if( l == r ) {
+    //Left and right are of same type
+    if( l == Type::floatType || l->IsVector() ) {
+      //Left and right are floats or vec2/3/4
+       llvm::Value* result = ArithmeticExpr::fcomp(lhs, rhs, oper);
+       return result;
+    } else if( l == Type::intType ) {
+      llvm::Value* result = ArithmeticExpr::comp(lhs, rhs, oper);
+      return result;
+    }
+  } else {
+    //lhs and rhs are of different types
+    if( l == Type::floatType && r->IsVector() ) {
+      //Lhs is float rhs is vec, splat lhs and do one vector op
+      llvm::Value* splat = irgen->IRGenerator::CreateSplat(lhs, r->Size());
+      return ArithmeticExpr::fcomp(splat, rhs, oper);
+    } else if( l->IsVector() && r == Type::floatType ) {
+      //Lhs is vec rhs is float, splat rhs and do one vector op
+      llvm::Value* splat = irgen->IRGenerator::CreateSplat(rhs, l->Size());
+      return ArithmeticExpr::fcomp(lhs, splat, oper);
+    }
+  }
+  return NULL;
+}
+
+/* With -ffp-contract=on/fast (or -ffast-math), a*b + c and c - a*b are
+ * emitted as a single llvm.fmuladd, outside precise regions. Returns
+ * NULL when this expression is not such a pattern.
+ */
+llvm::Value* ArithmeticExpr::EmitContracted() {
+  char* oper = op->getOp();
+  if( !irgen->IRGenerator::AllowContraction() ||
+	(strcmp(oper, "+") != 0 && strcmp(oper, "-") != 0) ) {
+    return NULL;
+  }
+  ArithmeticExpr* mul = dynamic_cast<ArithmeticExpr*>(left);
+  bool mulLeft = true;
+  if( mul == NULL || mul->left == NULL || strcmp(mul->op->getOp(), "*") ) {
+    mul = dynamic_cast<ArithmeticExpr*>(right);
+    mulLeft = false;
+  }
+  if( mul == NULL || mul->left == NULL || strcmp(mul->op->getOp(), "*") ) {
+    return NULL;
+  }
+  //fusable only when everything is float or one vector type, with
+  //float factors splatted; int, matrix and mixed forms are not
+  Type* t = staticType;
+  Expr* otherExpr = mulLeft ? right : left;
+  Type* ta = mul->left->getType();
+  Type* tb = mul->right->getType();
+  if( (t != Type::floatType && !t->IsVector()) || mul->getType() != t ||
+	otherExpr->getType() != t || (ta != t && ta != Type::floatType) ||
+	(tb != t && tb != Type::floatType) ) {
+    return NULL;
+  }
+  llvm::Value* other = mulLeft ? NULL : left->Emit();
+  llvm::Value* a = mul->left->Emit();
+  llvm::Value* b = mul->right->Emit();
+  if( mulLeft ) {
+    other = right->Emit();
+  }
+  if( ta != t ) {
+    a = irgen->IRGenerator::CreateSplat(a, t->Size());
+  }
+  if( tb != t ) {
+    b = irgen->IRGenerator::CreateSplat(b, t->Size());
+  }
+  if( oper[0] == '-' ) {
+    //a*b - c == fmuladd(a, b, -c); c - a*b == fmuladd(-a, b, c)
+    if( mulLeft ) {
+      other = llvm::BinaryOperator::CreateFNeg(other, "",
 		irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* fRes = ArithmeticExpr::fcomp(lhs, val, oper);
-          llvm::InsertElementInst::Create(rhs, fRes, vecId, "", 
+    } else {
+      a = llvm::BinaryOperator::CreateFNeg(a, "",
 		irgen->IRGenerator::GetBasicBlock());
-        }
-        return rhs;
-      } else if( lType->isVectorTy() && rType->isFloatTy() ) {
-        //Lhs is vec rhs is float
-        llvm::VectorType* vec = (llvm::VectorType*) lType;
-        //VarExpr* leftV = dynamic_cast<VarExpr*>(left);
-        //llvm::Value* addr = leftV->EmitAddress();
-        for( int i = 0; i < vec->getNumElements(); ++i ) {
-          //llvm::Value* baseAddr = new llvm::LoadInst(addr, "",
-          //      irgen->IRGenerator::GetBasicBlock());
-          llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* val = llvm::ExtractElementInst::Create(lhs, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* fRes = ArithmeticExpr::fcomp(val, rhs, oper);
-          llvm::InsertElementInst::Create(lhs, fRes, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-        return lhs;
-      /*
-      //TODO: float with mat2/3/4?? EC??
-      } else if( lhs->getType() == lType ) {
-      
-      //TODO:: vec2/3/4 with mat2/3/4?? 
-      } else if( lhs->getType() == lType ) {
-      
-      }
-      */
-      }
     }
-  
   }
-  return NULL;
+  return irgen->IRGenerator::CreateFMulAdd(a, b, other);
+}
+
+/* Both operands constant (literals, unrolled loop indices): fold instead
+ * of emitting. Integer division by zero and INT_MIN / -1 are left for run
+ * time; +, - and * fold through APInt and wrap.
+ */
+llvm::Value* ArithmeticExpr::fold(llvm::Value* lhs, llvm::Value* rhs,
+	char* oper, bool isFloat) {
+  llvm::Constant* l = llvm::dyn_cast<llvm::Constant>(lhs);
+  llvm::Constant* r = llvm::dyn_cast<llvm::Constant>(rhs);
+  if( l == NULL || r == NULL ) {
+    return NULL;
+  }
+  llvm::Instruction::BinaryOps binOp;
+  if( strcmp(oper, "+") == 0 ) {
+    binOp = isFloat ? llvm::Instruction::FAdd : llvm::Instruction::Add;
+  } else if( strcmp(oper, "-") == 0 ) {
+    binOp = isFloat ? llvm::Instruction::FSub : llvm::Instruction::Sub;
+  } else if( strcmp(oper, "*") == 0 ) {
+    binOp = isFloat ? llvm::Instruction::FMul : llvm::Instruction::Mul;
+  } else {
+    if( !isFloat && (r->isNullValue() ||
+	(r->isAllOnesValue() && l->isMinSignedValue())) ) {
+      return NULL;
+    }
+    binOp = isFloat ? llvm::Instruction::FDiv : llvm::Instruction::SDiv;
+  }
+  return llvm::ConstantExpr::get(binOp, l, r);
 }
 
 llvm::Value* ArithmeticExpr::comp(llvm::Value* lhs, 
 	llvm::Value* rhs, char* oper) {
+  if( llvm::Value* folded = fold(lhs, rhs, oper, false) ) {
+    return folded;
+  }
   if( strcmp(oper, "+") == 0 ) {
     //Operation add
     llvm::Value* result =
-	llvm::BinaryOperator::CreateAdd(lhs, rhs, "",
-        irgen->IRGenerator::GetBasicBlock());
+	irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Add, lhs, rhs);
     return result;
   } else if( strcmp(oper, "-") == 0 ) {
     //Operation sub
     llvm::Value* result =
-        llvm::BinaryOperator::CreateSub(lhs, rhs, "",
-        irgen->IRGenerator::GetBasicBlock());
+        irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Sub, lhs, rhs);
     return result;
   } else if( strcmp(oper, "*") == 0 ) {
     //Operation mul
     llvm::Value* result =
-        llvm::BinaryOperator::CreateMul(lhs, rhs, "",
-        irgen->IRGenerator::GetBasicBlock());
+        irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Mul, lhs, rhs);
     return result;
   } else {
     //Operation div
@@ -444,6 +1027,9 @@ llvm::Value* ArithmeticExpr::comp(llvm::Value* lhs,
 
 llvm::Value* ArithmeticExpr::fcomp(llvm::Value* lhs, 
 	llvm::Value* rhs, char* oper) {
+  if( llvm::Value* folded = fold(lhs, rhs, oper, true) ) {
+    return folded;
+  }
   if( strcmp(oper, "+") == 0 ) {
     //Operation add
     llvm::Value* result =
@@ -472,16 +1058,46 @@ llvm::Value* ArithmeticExpr::fcomp(llvm::Value* lhs,
   return NULL;
 }
 
-llvm::Value* RelationalExpr::Emit() {
-  if( DEBUG ) {
-    printf("Relational\n");
+/* Matrix arithmetic: mat*vec, vec*mat and mat*mat are linear algebra
+ * products, everything else (mat+-/mat, scalar with mat) is component-wise.
+ */
+llvm::Value* ArithmeticExpr::mcomp(llvm::Value* lhs, 
+	llvm::Value* rhs, Type* l, Type* r, char* oper) {
+  llvm::Instruction::BinaryOps binOp;
+  if( strcmp(oper, "+") == 0 ) {
+    binOp = llvm::Instruction::FAdd;
+  } else if( strcmp(oper, "-") == 0 ) {
+    binOp = llvm::Instruction::FSub;
+  } else if( strcmp(oper, "*") == 0 ) {
+    binOp = llvm::Instruction::FMul;
+  } else {
+    binOp = llvm::Instruction::FDiv;
+  }
+  if( l->IsMatrix() && r->IsMatrix() ) {
+    if( binOp == llvm::Instruction::FMul ) {
+      return irgen->IRGenerator::CreateMatMatMul(lhs, rhs);
+    }
+    return irgen->IRGenerator::CreateMatBinOp(binOp, lhs, rhs);
+  } else if( l->IsMatrix() && r->IsVector() ) {
+    //mat * vec
+    return irgen->IRGenerator::CreateMatVecMul(lhs, rhs);
+  } else if( l->IsVector() && r->IsMatrix() ) {
+    //vec * mat
+    return irgen->IRGenerator::CreateVecMatMul(lhs, rhs);
+  } else if( l->IsMatrix() ) {
+    //mat op float
+    return irgen->IRGenerator::CreateMatScalarOp(binOp, lhs, rhs, false);
   }
+  //float op mat
+  return irgen->IRGenerator::CreateMatScalarOp(binOp, rhs, lhs, true);
+}
+
+llvm::Value* RelationalExpr::Emit() {
+  TRACE(TraceEmit, "Relational");
   llvm::Value* lhs = left->Emit();
   llvm::Value* rhs = right->Emit();
-  llvm::Type* lType = lhs->getType();
-  llvm::Type* rType = rhs->getType();
   char* oper = op->getOp();
-  if( lType->isFloatTy() ) {
+  if( left->getType() == Type::floatType ) {
     //lhs is float
     llvm::CmpInst::OtherOps llvmOP = llvm::CmpInst::FCmp;
     llvm::CmpInst::Predicate pred;
@@ -501,10 +1117,14 @@ llvm::Value* RelationalExpr::Emit() {
       //Get rid of warning
       pred = llvm::CmpInst::FCMP_OLE;
     }
+    if( llvm::isa<llvm::Constant>(lhs) && llvm::isa<llvm::Constant>(rhs) ) {
+      return llvm::ConstantExpr::getCompare(pred,
+		llvm::cast<llvm::Constant>(lhs), llvm::cast<llvm::Constant>(rhs));
+    }
     llvm::Value* result = llvm::CmpInst::Create(llvmOP, pred, lhs, rhs, "", 
 	irgen->IRGenerator::GetBasicBlock());
     return result;
-  } else if( rType->isIntegerTy() ) {
+  } else if( left->getType() == Type::intType ) {
     //lhs is int
     llvm::CmpInst::OtherOps llvmOP = llvm::CmpInst::ICmp;
     llvm::CmpInst::Predicate pred;
@@ -524,6 +1144,10 @@ llvm::Value* RelationalExpr::Emit() {
       //Get rid of warning
       pred = llvm::CmpInst::ICMP_SLE;
     }
+    if( llvm::isa<llvm::Constant>(lhs) && llvm::isa<llvm::Constant>(rhs) ) {
+      return llvm::ConstantExpr::getCompare(pred,
+		llvm::cast<llvm::Constant>(lhs), llvm::cast<llvm::Constant>(rhs));
+    }
     llvm::Value* result = llvm::CmpInst::Create(llvmOP, pred, lhs, rhs, "",
 	irgen->IRGenerator::GetBasicBlock());
     return result;
@@ -532,15 +1156,12 @@ llvm::Value* RelationalExpr::Emit() {
 }
 
 llvm::Value* EqualityExpr::Emit() {
-  if( DEBUG ) {
-    printf("Equality\n");
-  }
+  TRACE(TraceEmit, "Equality");
   llvm::Value* lhs = left->Emit();
   llvm::Value* rhs = right->Emit();
-  llvm::Type* lType = lhs->getType();
-  llvm::Type* rType = rhs->getType();
+  Type* l = left->getType();
   char* oper = op->getOp();
-  if( lType->isFloatTy() ) {
+  if( l == Type::floatType ) {
     //lhs is float
     llvm::CmpInst::OtherOps llvmOP = llvm::CmpInst::FCmp;
     llvm::CmpInst::Predicate pred;
@@ -554,10 +1175,14 @@ llvm::Value* EqualityExpr::Emit() {
       //Get rid of warning
       pred = llvm::CmpInst::FCMP_ONE;
     }
+    if( llvm::isa<llvm::Constant>(lhs) && llvm::isa<llvm::Constant>(rhs) ) {
+      return llvm::ConstantExpr::getCompare(pred,
+		llvm::cast<llvm::Constant>(lhs), llvm::cast<llvm::Constant>(rhs));
+    }
     llvm::Value* result = llvm::CmpInst::Create(llvmOP, pred, lhs, rhs, "",
 	irgen->IRGenerator::GetBasicBlock());
     return result;
-  } else if( lType->isIntegerTy() ) {
+  } else if( l == Type::intType || l == Type::boolType ) {
     //lhs is int or bool
     llvm::CmpInst::OtherOps llvmOP = llvm::CmpInst::ICmp;
     llvm::CmpInst::Predicate pred;
@@ -571,36 +1196,17 @@ llvm::Value* EqualityExpr::Emit() {
       //Get rid of warning
       pred = llvm::CmpInst::ICMP_NE;
     }
+    if( llvm::isa<llvm::Constant>(lhs) && llvm::isa<llvm::Constant>(rhs) ) {
+      return llvm::ConstantExpr::getCompare(pred,
+		llvm::cast<llvm::Constant>(lhs), llvm::cast<llvm::Constant>(rhs));
+    }
     llvm::Value* result = llvm::CmpInst::Create(llvmOP, pred, lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
     return result;
-  } else if ( lType->isVectorTy() ) {
-    llvm::CmpInst::OtherOps llvmOP = llvm::CmpInst::FCmp;
-    llvm::CmpInst::Predicate pred = llvm::CmpInst::FCMP_OEQ;
-    llvm::Value* vecResult = llvm::CmpInst::Create(llvmOP, pred, lhs, rhs, "",
-	irgen->IRGenerator::GetBasicBlock());
-    llvm::VectorType* vec = (llvm::VectorType *) vecResult->getType();
-    llvm::Value* ind = llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(),
-	0, false);
-    llvm::Value* result = llvm::ExtractElementInst::Create(vecResult,
-	 ind, "", irgen->IRGenerator::GetBasicBlock());
-    //TODO: getNumElements() may not return correct number
-    for( int i = 1; i < vec->getNumElements(); ++i ) {
-      llvm::Value* index = 
-	llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), i, false);
-      llvm::Value *next = llvm::ExtractElementInst::Create(vecResult, index, "",
-	irgen->IRGenerator::GetBasicBlock());
-      result = llvm::BinaryOperator::CreateAnd(result, next, "", 
-	irgen->IRGenerator::GetBasicBlock());
-    }
-    if( strcmp(oper, "==") == 0 ) {
-      //Is equal operation
-      return result;
-    } else {
-      //Is not equal operation
-      return llvm::BinaryOperator::CreateNot(result, "",
-	irgen->IRGenerator::GetBasicBlock());
-    }
+  } else if( l->IsVector() || l->IsMatrix() ) {
+    //one lane-wise compare, then a single reduction of the lane mask
+    bool equal = ( strcmp(oper, "==") == 0 );
+    return irgen->IRGenerator::CreateAggregateCompare(equal, lhs, rhs);
   }
   //TODO: Can this have a void type?
   return NULL;
@@ -627,20 +1233,32 @@ llvm::Value* LogicalExpr::Emit() {
   return NULL;
 }
 
+/* True when the assigned variable, or the vector a swizzle writes into,
+ * was declared precise.
+ */
+bool AssignExpr::IsPrecise() {
+  VarDecl* d = TargetOf(left);
+  return d != NULL && d->IsPrecise();
+}
+
 llvm::Value* AssignExpr::Emit() {
-  if( DEBUG ) {
-    printf("Assign\n");
+  if( !IsPrecise() ) {
+    return EmitAssign();
   }
-  llvm::Value* lhsAddr;
+  irgen->IRGenerator::BeginPrecise();
+  llvm::Value* result = EmitAssign();
+  irgen->IRGenerator::EndPrecise();
+  return result;
+}
+
+llvm::Value* AssignExpr::EmitAssign() {
+  TRACE(TraceEmit, "Assign");
+  llvm::Value* lhsAddr = NULL;
   llvm::Value* lhs;
-  const char* cSwiz = "";
   if( VarExpr* leftV = dynamic_cast<VarExpr*>(left) ) {;
     lhsAddr = leftV->EmitAddress();
-  } else if( FieldAccess *f = dynamic_cast<FieldAccess*>(left)) {
-    lhsAddr = f->EmitAddress();
-    cSwiz = f->getId()->getName();
-  } else {
-    if( DEBUG ) printf("assign expr not var or field\n");
+  } else if( dynamic_cast<FieldAccess*>(left) == NULL ) {
+    TRACE(TraceEmit, "assign expr not var or field");
     lhsAddr = right->Emit();
   }
   
@@ -648,381 +1266,114 @@ llvm::Value* AssignExpr::Emit() {
   if( llvm::StoreInst* si = dynamic_cast<llvm::StoreInst*>(rhs) ) {
     rhs = si->getValueOperand();
   }
-  llvm::Type* lType;
-  llvm::Type* rType = rhs->getType();
+  Type* lt = left->getType();
+  Type* rt = right->getType();
   char* oper = op->getOp();
+  if( FieldAccess* f = dynamic_cast<FieldAccess*>(left) ) {
+    //swizzle target: a float rhs fills every lane, and the result goes
+    //back through the composed lane mask
+    llvm::Value* result = rhs;
+    if( strcmp(oper, "=") != 0 ) {
+      char arith[2] = { oper[0], '\0' };
+      result = ArithmeticExpr::binop(f->Emit(), rhs, lt, rt, arith);
+    } else if( lt->IsVector() && rt == Type::floatType ) {
+      result = irgen->IRGenerator::CreateSplat(rhs, lt->Size());
+    }
+    f->EmitStore(result);
+    return result;
+  }
+  if( strcmp(oper, "=") != 0 && (lt->IsMatrix() || rt->IsMatrix()) ) {
+    //compound assignment involving mat2/3/4
+    char arith[2] = { oper[0], '\0' };
+    lhs = left->Emit();
+    llvm::Value* result = ArithmeticExpr::mcomp(lhs, rhs, lt, rt, arith);
+    new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
+    return result;
+  }
   if( strcmp(oper, "=") == 0 ) {
     //normal assign
-    if( strlen(cSwiz) != 0 ) {
-      //Is field assignment
-      llvm::Value* baseAddr = new llvm::LoadInst(lhsAddr, "",
-		irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      if( rType->isVectorTy() ) {
-        //Assigning vector to a vector
-        for( int i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-		irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Constant* extPos = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* ext = llvm::ExtractElementInst::Create(rhs, extPos, "",
-		irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, ext, vecId, "",
-		irgen->IRGenerator::GetBasicBlock());
-        }
-      } else if( rType->isFloatTy() ) {
-        //Assigning float to a vector
-        for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, rhs, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-      }
-      llvm::Value* result = new llvm::StoreInst(baseAddr, lhsAddr, "",
-		irgen->IRGenerator::GetBasicBlock());
-      //TODO: check if works
-      return rhs;
-      //return result;
-    }
     llvm::Value* result = new llvm::StoreInst(rhs, lhsAddr,
 	irgen->IRGenerator::GetBasicBlock());
     return rhs;
     return result;
   } else if( strcmp(oper, "+=") == 0 ) {
     //plus equals
-    if( strlen(cSwiz) != 0 ) {
-      //Is field assignment
-      llvm::Value* baseAddr = new llvm::LoadInst(lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      if( rType->isVectorTy() ) {
-        //Assigning vector to a vector
-        for( int i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Constant* extPos = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* extR = llvm::ExtractElementInst::Create(rhs, extPos, "",
-                irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId, 
-		"", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFAdd(extL, extR, "",
-		irgen->IRGenerator::GetBasicBlock()); 
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-      } else if( rType->isFloatTy() ) {
-        //Assigning float to a vector
-        for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-		"", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFAdd(extL, rhs, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-        llvm::Value* result = new llvm::StoreInst(baseAddr, lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-        return rhs;
-      }
-    }
     lhs = left->Emit();
-    lType = lhs->getType();
-    if( lType->isFloatTy() || lType->isVectorTy() ) {
+    if( lt->IsVector() && rt == Type::floatType ) {
+      //scalar rhs is splatted so the update stays one vector op
+      rhs = irgen->IRGenerator::CreateSplat(rhs,
+		lt->Size());
+    }
+    if( lt == Type::floatType || lt->IsVector() ) {
       //lhs is float or vec2/3/4
       llvm::Value* result = llvm::BinaryOperator::CreateFAdd(lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
-    } else if( lType->isIntegerTy() ) {
+    } else if( lt == Type::intType ) {
       //lhs is integer
-      llvm::Value* result = llvm::BinaryOperator::CreateAdd(lhs, rhs, "", 
-	irgen->IRGenerator::GetBasicBlock());
+      llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Add, lhs, rhs);
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
     }
   } else if( strcmp(oper, "-=") == 0 ) {
     //minus equals
-    if( strlen(cSwiz) != 0 ) {
-      //Is field assignment
-      llvm::Value* baseAddr = new llvm::LoadInst(lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      if( rType->isVectorTy() ) {
-        //Assigning vector to a vector
-        for( int i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Constant* extPos = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* extR = llvm::ExtractElementInst::Create(rhs, extPos, "",
-                irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFSub(extL, extR, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-      } else if( rType->isFloatTy() ) {
-        //Assigning float to a vector
-        for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFSub(extL, rhs, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-        llvm::Value* result = new llvm::StoreInst(baseAddr, lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-        return rhs;
-      }
-    }
     lhs = left->Emit();
-    lType = lhs->getType();
-    if( lType->isFloatTy() || lType->isVectorTy() ) {
+    if( lt->IsVector() && rt == Type::floatType ) {
+      //scalar rhs is splatted so the update stays one vector op
+      rhs = irgen->IRGenerator::CreateSplat(rhs,
+		lt->Size());
+    }
+    if( lt == Type::floatType || lt->IsVector() ) {
       //lhs is float or vec2/3/4
       llvm::Value* result = llvm::BinaryOperator::CreateFSub(lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
-    } else if( lType->isIntegerTy() ) {
+    } else if( lt == Type::intType ) {
       //lhs is integer
-      llvm::Value* result = llvm::BinaryOperator::CreateSub(lhs, rhs, "",
-        irgen->IRGenerator::GetBasicBlock());
+      llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Sub, lhs, rhs);
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
     }
   } else if( strcmp(oper, "*=") == 0 ) {
     //multipy equals
-    if( strlen(cSwiz) != 0 ) {
-      //Is field assignment
-      llvm::Value* baseAddr = new llvm::LoadInst(lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      if( rType->isVectorTy() ) {
-        //Assigning vector to a vector
-        for( int i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Constant* extPos = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* extR = llvm::ExtractElementInst::Create(rhs, extPos, "",
-                irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFMul(extL, extR, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-      } else if( rType->isFloatTy() ) {
-        //Assigning float to a vector
-        for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFMul(extL, rhs, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-        llvm::Value* result = new llvm::StoreInst(baseAddr, lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-        return rhs;
-      }
-    }
     lhs = left->Emit();
-    lType = lhs->getType();
-    if( lType->isFloatTy() || lType->isVectorTy() ) {
+    if( lt->IsVector() && rt == Type::floatType ) {
+      //scalar rhs is splatted so the update stays one vector op
+      rhs = irgen->IRGenerator::CreateSplat(rhs,
+		lt->Size());
+    }
+    if( lt == Type::floatType || lt->IsVector() ) {
       //lhs is float or vec2/3/4
       llvm::Value* result = llvm::BinaryOperator::CreateFMul(lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
-    } else if( lType->isIntegerTy() ) {
+    } else if( lt == Type::intType ) {
       //lhs is integer
-      llvm::Value* result = llvm::BinaryOperator::CreateMul(lhs, rhs, "",
-        irgen->IRGenerator::GetBasicBlock());
+      llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Mul, lhs, rhs);
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;
     }
   } else if( strcmp(oper, "/=") == 0 ) {
     //divide equals
-    if( strlen(cSwiz) != 0 ) {
-      //Is field assignment
-      llvm::Value* baseAddr = new llvm::LoadInst(lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-      llvm::Constant* vecId;
-      if( rType->isVectorTy() ) {
-        //Assigning vector to a vector
-        for( int i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Constant* extPos = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), i);
-          llvm::Value* extR = llvm::ExtractElementInst::Create(rhs, extPos, "",
-                irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFDiv(extL, extR, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-      } else if( rType->isFloatTy() ) {
-        //Assigning float to a vector
-        for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-          char c = cSwiz[i];
-          if( c == 'x' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-          } else if( c == 'y' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-          } else if( c == 'z' ) {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-          } else {
-            vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-          }
-          llvm::Value* extL = llvm::ExtractElementInst::Create(baseAddr, vecId,
-                "", irgen->IRGenerator::GetBasicBlock());
-          llvm::Value* binOp = llvm::BinaryOperator::CreateFDiv(extL, rhs, "",
-                irgen->IRGenerator::GetBasicBlock());
-          baseAddr = llvm::InsertElementInst::Create(baseAddr, binOp, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-        }
-        llvm::Value* result = new llvm::StoreInst(baseAddr, lhsAddr, "",
-                irgen->IRGenerator::GetBasicBlock());
-        return rhs;
-      }
-    }
     lhs = left->Emit();
-    lType = lhs->getType();
-    if( lType->isFloatTy() || lType->isVectorTy() ) {
+    if( lt->IsVector() && rt == Type::floatType ) {
+      //scalar rhs is splatted so the update stays one vector op
+      rhs = irgen->IRGenerator::CreateSplat(rhs,
+		lt->Size());
+    }
+    if( lt == Type::floatType || lt->IsVector() ) {
       //lhs is float or vec2/3/4
       llvm::Value* result = llvm::BinaryOperator::CreateFDiv(lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
       new llvm::StoreInst(result, lhsAddr, irgen->IRGenerator::GetBasicBlock());
       return result;   
-    } else if( lType->isIntegerTy() ) {
+    } else if( lt == Type::intType ) {
       //lhs is integer
       llvm::Value* result = llvm::BinaryOperator::CreateSDiv(lhs, rhs, "",
         irgen->IRGenerator::GetBasicBlock());
@@ -1038,66 +1389,26 @@ llvm::Value* AssignExpr::Emit() {
 }
 
 llvm::Value* PostfixExpr::Emit() {
-  if( DEBUG ) {
-    printf("Postfix\n");
-  }
+  TRACE(TraceEmit, "Postfix");
   llvm::Value* lhs = left->Emit();
-  llvm::Value* addr;
-  const char* cSwiz = "";
+  llvm::Value* addr = NULL;
   if( VarExpr* leftV = dynamic_cast<VarExpr*>(left) ) {
     addr = leftV->EmitAddress();
-  } else if( FieldAccess* f = dynamic_cast<FieldAccess*>(left) ) {
-    addr = f->EmitAddress();
-    cSwiz = f->getId()->getName();
-  } else {
-    if( DEBUG ) printf("postfix address not var or field\n");
+  } else if( dynamic_cast<FieldAccess*>(left) == NULL ) {
+    TRACE(TraceEmit, "postfix address not var or field");
     addr = left->Emit();
   }
   
   llvm::Type* lType = lhs->getType();
   char* oper = op->getOp();
-  if( strlen(cSwiz) != 0 ) {
-    //field assignment
-    llvm::Constant* inc = llvm::ConstantFP::get(
-		irgen->IRGenerator::GetFloatType(), 1.0);
-    llvm::Value* baseAddr = new llvm::LoadInst(addr, "",
-		irgen->IRGenerator::GetBasicBlock());
-    llvm::Value* baseAddr1 = baseAddr;
-    llvm::Constant* vecId;
-    for( unsigned i = 0; i < strlen(cSwiz); i++ ) {
-      char c = cSwiz[i];
-      if( c == 'x' ) {
-        vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 0);
-      } else if( c == 'y' ) {
-        vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 1);
-      } else if( c == 'z' ) {
-        vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 2);
-      } else {
-        vecId = llvm::ConstantInt::get(
-                irgen->IRGenerator::GetIntType(), 3);
-      }
-      llvm::Value* ext = llvm::ExtractElementInst::Create(baseAddr, vecId, "",
-		irgen->IRGenerator::GetBasicBlock());
-      if( strcmp(oper, "++") == 0 ) {
-        llvm::Value* result = llvm::BinaryOperator::CreateFAdd(ext, inc, "",
-		irgen->IRGenerator::GetBasicBlock());
-        baseAddr = llvm::InsertElementInst::Create(baseAddr, result, vecId, "",
-		irgen->IRGenerator::GetBasicBlock());
-      } else if( strcmp(oper, "--") == 0 ) {
-        llvm::Value* result = llvm::BinaryOperator::CreateFSub(ext, inc, "",
-                irgen->IRGenerator::GetBasicBlock());
-        baseAddr = llvm::InsertElementInst::Create(baseAddr, result, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-      } else {
-        //shouldnt be here
-      } 
-    }
-    llvm::Value* res = new llvm::StoreInst(baseAddr, addr, "",
-		irgen->IRGenerator::GetBasicBlock());
-    return baseAddr1;
+  if( FieldAccess* f = dynamic_cast<FieldAccess*>(left) ) {
+    //swizzled operand, written back through the lane mask
+    llvm::Constant* one = llvm::ConstantFP::get(lType, 1.0);
+    llvm::BasicBlock* bb = irgen->IRGenerator::GetBasicBlock();
+    f->EmitStore(strcmp(oper, "++") == 0
+	? llvm::BinaryOperator::CreateFAdd(lhs, one, "", bb)
+	: llvm::BinaryOperator::CreateFSub(lhs, one, "", bb));
+    return lhs;
   }
   if( lType->isVectorTy() ) {
     llvm::VectorType* vec = (llvm::VectorType*) lType;
@@ -1154,8 +1465,8 @@ llvm::Value* PostfixExpr::Emit() {
       //Postfix inc
       llvm::Type* iConst = irgen->IRGenerator::GetIntType();
       llvm::Value* inc = llvm::ConstantInt::get(iConst, 1, true);
-      llvm::Value* result = llvm::BinaryOperator::CreateAdd(lhs, inc, "",
-                irgen->IRGenerator::GetBasicBlock());
+      llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Add, lhs, inc);
       new llvm::StoreInst(result, addr,
                 irgen->IRGenerator::GetBasicBlock());
       return lhs;
@@ -1163,20 +1474,23 @@ llvm::Value* PostfixExpr::Emit() {
       //Postfix dec
       llvm::Type* iConst = irgen->IRGenerator::GetIntType();
       llvm::Value* dec = llvm::ConstantInt::get(iConst, 1, true);
-      llvm::Value* result = llvm::BinaryOperator::CreateSub(lhs, dec, "",
-                irgen->IRGenerator::GetBasicBlock());
+      llvm::Value* result = irgen->IRGenerator::CreateIntOp(
+		llvm::Instruction::Sub, lhs, dec);
       new llvm::StoreInst(result, addr,
                 irgen->IRGenerator::GetBasicBlock());
       return lhs;
     } else {
       //are there any other postfix ops?
     }
-  /*
-  //TODO:: mat2/3/4 EC???
-  } else if( lhs->getType() == lType ) {
-    
-  }
-  */
+  } else if( lType->isArrayTy() ) {
+    //mat2/3/4, every component steps by one
+    llvm::Constant* one = llvm::ConstantFP::get(
+		irgen->IRGenerator::GetFloatType(), 1.0);
+    llvm::Value* result = irgen->IRGenerator::CreateMatScalarOp(
+		oper[0] == '+' ? llvm::Instruction::FAdd : llvm::Instruction::FSub,
+		lhs, one, false);
+    new llvm::StoreInst(result, addr, irgen->IRGenerator::GetBasicBlock());
+    return lhs;
   }
   return NULL;
 }
@@ -1186,106 +1500,178 @@ ArrayAccess::ArrayAccess(yyltype loc, Expr *b, Expr *s) : LValue(loc) {
     (subscript=s)->SetParent(this);
 }
 
+void ArrayAccess::Resolve() {
+  base->Resolve();
+  subscript->Resolve();
+  ReportError::Formatted(GetLocation(), "Array subscripts are not supported");
+  staticType = Type::errorType;
+}
+
 void ArrayAccess::PrintChildren(int indentLevel) {
     base->Print(indentLevel+1);
     subscript->Print(indentLevel+1, "(subscript) ");
   }
      
 FieldAccess::FieldAccess(Expr *b, Identifier *f) 
-  : LValue(b? Join(b->GetLocation(), f->GetLocation()) : *f->GetLocation()) {
+  : LValue(b? Join(b->GetLocation(), f->GetLocation()) : f->GetLocation()) {
     Assert(f != NULL); // b can be be NULL (just means no explicit base)
     base = b; 
     if (base) base->SetParent(this); 
     (field=f)->SetParent(this);
 }
 
-llvm::Value* FieldAccess::Emit() {
-  if( DEBUG ) {
-    printf("FieldAccess\n");
+/* Maps a single swizzle character onto its vector lane. The xyzw, rgba
+ * and stpq sets all name the same four lanes.
+ */
+int FieldAccess::SwizzleIndex(char c) {
+  switch( c ) {
+    case 'x': case 'r': case 's': return 0;
+    case 'y': case 'g': case 't': return 1;
+    case 'z': case 'b': case 'p': return 2;
+    default:                      return 3;
   }
-  llvm::Value* lhs = base->Emit();
-  const char* swizC = field->getName();
-  std::vector<llvm::Constant*> indices;
-  int len = strlen(swizC);
-  if( len == 1 ) {
-    char c = swizC[0];
-    if( c == 'x' ) {
-      //first element
-      llvm::Constant* vecId =
-		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 0);
-      llvm::Value* result = llvm::ExtractElementInst::Create(lhs, vecId, "",
-		irgen->IRGenerator::GetBasicBlock());
-      return result;
-    } else if( c == 'y' ) {
-      //second element
-      llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 1);
-      llvm::Value* result = llvm::ExtractElementInst::Create(lhs, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-      return result;
-    } else if( c == 'z' ) {
-      //third element
-      llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 2);
-      llvm::Value* result = llvm::ExtractElementInst::Create(lhs, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-      return result;
-    } else {
-      //fourth element
-      llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 3);
-      llvm::Value* result = llvm::ExtractElementInst::Create(lhs, vecId, "",
-                irgen->IRGenerator::GetBasicBlock());
-      return result;
+}
+
+/* A swizzle of up to four lanes that all exist in the base vector; one
+ * lane is a float, more are the vector of that width.
+ */
+void FieldAccess::Resolve() {
+  if( base ) {
+    base->Resolve();
+  }
+  staticType = Type::errorType;
+  Type* b = TypeOf(base);
+  if( b == Type::errorType ) {
+    return;
+  }
+  if( !b->IsVector() ) {
+    ReportError::InaccessibleSwizzle(field, b);
+    return;
+  }
+  const char* swiz = field->getName();
+  for( int i = 0; swiz[i] != '\0'; ++i ) {
+    if( strchr("xyzwrgbastpq", swiz[i]) == NULL ) {
+      ReportError::InvalidSwizzle(field);
+      return;
     }
-  } else {
-    for(int i = 0; i < len; ++i) {
-      char c = swizC[i];
-      if( c == 'x' ) {
-        //first element
-        llvm::Constant* vecId =
-		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 0);
-        indices.push_back(vecId);
-      } else if( c == 'y' ) {
-        //second element
-        llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 1);
-        indices.push_back(vecId);
-      } else if( c == 'z' ) {
-        //third element    
-        llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 2);
-        indices.push_back(vecId);
-      } else {
-        //fourth element
-        llvm::Constant* vecId =
-                llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), 3);
-        indices.push_back(vecId);
-      }
+    if( SwizzleIndex(swiz[i]) >= b->Size() ) {
+      ReportError::SwizzleOutOfBound(field, b);
+      return;
     }
-    llvm::ConstantVector* mask = 
-		(llvm::ConstantVector *)llvm::ConstantVector::get(indices);
-    llvm::Value* result = new llvm::ShuffleVectorInst(lhs, llvm::UndefValue::get(
-	lhs->getType()), mask, "", irgen->IRGenerator::GetBasicBlock());
+  }
+  if( strlen(swiz) > 4 ) {
+    ReportError::OversizedVector(field);
+    return;
+  }
+  staticType = Type::FloatVector(strlen(swiz));
+}
+
+/* Folds a chain of swizzles such as v.zyx.xz into one lane mask over the
+ * innermost non-swizzle base, which is returned. Each outer lane simply
+ * picks one of the lanes the inner swizzle already selected.
+ */
+Expr* FieldAccess::ComposeSwizzle(std::vector<int> &mask) {
+  std::vector<int> inner;
+  Expr* root = base;
+  if( FieldAccess* f = dynamic_cast<FieldAccess*>(base) ) {
+    root = f->ComposeSwizzle(inner);
+  }
+  const char* swizC = field->getName();
+  mask.clear();
+  for( int i = 0; swizC[i] != '\0'; ++i ) {
+    int lane = SwizzleIndex(swizC[i]);
+    if( !inner.empty() && lane < (int) inner.size() ) {
+      lane = inner[lane];
+    }
+    mask.push_back(lane);
+  }
+  return root;
+}
+
+llvm::Value* FieldAccess::Emit() {
+  TRACE(TraceEmit, "FieldAccess");
+  std::vector<int> mask;
+  Expr* root = ComposeSwizzle(mask);
+  llvm::Value* lhs = root->Emit();
+  llvm::VectorType* vec = (llvm::VectorType*) lhs->getType();
+  if( mask.size() == 1 ) {
+    //single lane read
+    llvm::Constant* vecId =
+		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), mask[0]);
+    llvm::Value* result = llvm::ExtractElementInst::Create(lhs, vecId, "",
+		irgen->IRGenerator::GetBasicBlock());
     return result;
   }
+  bool identity = (mask.size() == vec->getNumElements());
+  for( unsigned i = 0; identity && i < mask.size(); ++i ) {
+    identity = (mask[i] == (int) i);
+  }
+  if( identity ) {
+    //v.xyzw and friends are the vector itself
+    return lhs;
+  }
+  std::vector<llvm::Constant*> indices;
+  for( unsigned i = 0; i < mask.size(); ++i ) {
+    indices.push_back(
+		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), mask[i]));
+  }
+  llvm::Constant* shuffleMask = llvm::ConstantVector::get(indices);
+  llvm::Value* result = new llvm::ShuffleVectorInst(lhs, llvm::UndefValue::get(
+	lhs->getType()), shuffleMask, "", irgen->IRGenerator::GetBasicBlock());
+  return result;
 }
 
 llvm::Value* FieldAccess::EmitAddress() {
-  if( DEBUG ) {
-    printf("Field Access EmitAddress\n");
-  }
+  TRACE(TraceEmit, "Field Access EmitAddress");
   const char *c = field->getName();
   if( VarExpr* varE = dynamic_cast<VarExpr*>(base) ) {
     return varE->EmitAddress();
   } else if( FieldAccess* f = dynamic_cast<FieldAccess*>(base) ) {
     return f->EmitAddress();
   } else {
-    if( DEBUG ) printf("fieldaccess not var or field\n");
+    TRACE(TraceEmit, "fieldaccess not var or field");
     return base->EmitAddress();
   }
 }
 
+/* Writes val into the swizzled lanes of the base vector: val is widened
+ * to the base width and blended in with a single shuffle.
+ */
+void FieldAccess::EmitStore(llvm::Value* val) {
+  TRACE(TraceEmit, "FieldAccess EmitStore");
+  llvm::BasicBlock* bb = irgen->IRGenerator::GetBasicBlock();
+  llvm::Value* addr = EmitAddress();
+  llvm::Value* vec = new llvm::LoadInst(addr, "", bb);
+  unsigned width = vec->getType()->getVectorNumElements();
+  std::vector<int> mask;
+  ComposeSwizzle(mask);
+  if( mask.size() == 1 ) {
+    llvm::Constant* vecId =
+		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(), mask[0]);
+    vec = llvm::InsertElementInst::Create(vec, val, vecId, "", bb);
+    new llvm::StoreInst(vec, addr, bb);
+    return;
+  }
+  std::vector<llvm::Constant*> widen, blend;
+  llvm::Type* intTy = irgen->IRGenerator::GetIntType();
+  for( unsigned i = 0; i < width; ++i ) {
+    blend.push_back(llvm::ConstantInt::get(intTy, i));
+    widen.push_back(llvm::UndefValue::get(intTy));
+  }
+  for( unsigned i = 0; i < mask.size(); ++i ) {
+    widen[mask[i]] = llvm::ConstantInt::get(intTy, i);
+    blend[mask[i]] = llvm::ConstantInt::get(intTy, width + mask[i]);
+  }
+  llvm::Value* wide = val;
+  if( mask.size() != width ) {
+    wide = new llvm::ShuffleVectorInst(val, llvm::UndefValue::get(
+	val->getType()), llvm::ConstantVector::get(widen), "", bb);
+  }
+  vec = new llvm::ShuffleVectorInst(vec, wide, llvm::ConstantVector::get(blend),
+	"", bb);
+  new llvm::StoreInst(vec, addr, bb);
+}
+
   void FieldAccess::PrintChildren(int indentLevel) {
     if (base) base->Print(indentLevel+1);
     field->Print(indentLevel+1);
@@ -1297,6 +1683,165 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
     if (base) base->SetParent(this);
     (field=f)->SetParent(this);
     (actuals=a)->SetParentAll(this);
+    fn = NULL;
+}
+
+/* A name that is no function in scope must be a built-in. in arguments
+ * only need to convert to the formal's type; out and inout ones must be
+ * variables or swizzles of exactly that type.
+ */
+/* 1-based position of the first argument the built-in name does not take,
+ * 0 if they all fit. Float arguments must match the type of the argument
+ * that gives the result type (the first one for dot and length).
+ */
+static int BadBuiltinArg(const char* name, List<Expr*>* actuals) {
+  bool ints = IRGenerator::HasBuiltinIntForm(name);
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    ints = ints && TypeOf(actuals->Nth(i)) == Type::intType;
+  }
+  if( ints ) {
+    return 0;
+  }
+  BuiltinArgs rule = IRGenerator::GetBuiltinArgs(name);
+  int from = IRGenerator::GetBuiltinResultArg(name);
+  Type* want = TypeOf(actuals->Nth(from < 0 ? 0 : from));
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    Type* t = TypeOf(actuals->Nth(i));
+    if( (t != Type::floatType && !t->IsVector()) ||
+	(rule == BA_Vec3 && t != Type::vec3Type) ||
+	(t != want && !(rule == BA_Splat && t == Type::floatType)) ) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+void Call::Resolve() {
+  if( base ) {
+    base->Resolve();
+  }
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    actuals->Nth(i)->Resolve();
+  }
+  const char* name = field->getName();
+  fn = dynamic_cast<FnDecl*>(S->find(name).decl);
+  staticType = Type::errorType;
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    if( TypeOf(actuals->Nth(i)) == Type::errorType ) {
+      return;
+    }
+  }
+  int given = actuals->NumElements();
+  if( fn == NULL ) {
+    int arity = IRGenerator::GetBuiltinArity(name);
+    if( arity < 0 ) {
+      ReportError::Formatted(GetLocation(), "'%s' is not a function", name);
+    } else if( arity != given ) {
+      ReportError::Formatted(GetLocation(),
+		"Function '%s' expects %d arguments but %d given",
+		name, arity, given);
+    } else if( int bad = BadBuiltinArg(name, actuals) ) {
+      ReportError::Formatted(actuals->Nth(bad - 1)->GetLocation(),
+		"Argument %d of '%s' cannot have type %s", bad, name,
+		TypeOf(actuals->Nth(bad - 1))->getName());
+    } else {
+      int from = IRGenerator::GetBuiltinResultArg(name);
+      staticType = from < 0 ? Type::floatType : TypeOf(actuals->Nth(from));
+    }
+    return;
+  }
+  List<VarDecl*>* formals = fn->getFormals();
+  if( formals->NumElements() != given ) {
+    ReportError::Formatted(GetLocation(),
+		"Function '%s' expects %d arguments but %d given",
+		name, formals->NumElements(), given);
+    return;
+  }
+  for( int i = 0; i < given; ++i ) {
+    VarDecl* formal = formals->Nth(i);
+    Expr* actual = actuals->Nth(i);
+    Type* want = formal->getType();
+    Type* have = TypeOf(actual);
+    if( formal->IsByReference() ) {
+      if( have != want || (dynamic_cast<VarExpr*>(actual) == NULL &&
+		dynamic_cast<FieldAccess*>(actual) == NULL) ) {
+        ReportError::Formatted(actual->GetLocation(),
+		"Argument %d of '%s' must be a %s variable", i + 1, name,
+		want->getName());
+        return;
+      }
+      if( !MarkWritten(actual) ) {
+        return;
+      }
+    } else if( !have->IsConvertibleTo(want) ) {
+      ReportError::Formatted(actual->GetLocation(),
+		"Argument %d of '%s' has type %s, %s expected", i + 1, name,
+		have->getName(), want->getName());
+      return;
+    }
+  }
+  staticType = fn->getReturnType();
+}
+
+/* in arguments are converted to the formal's type and passed by value.
+ * out and inout arguments pass the address of the actual; a swizzled
+ * actual goes through a temporary that is written back after the call.
+ */
+llvm::Value* Call::Emit() {
+  TRACE(TraceEmit, "Call");
+  if( fn == NULL ) {
+    return EmitBuiltin();
+  }
+  List<VarDecl*>* formals = fn->getFormals();
+  llvm::Function* callee = llvm::cast<llvm::Function>(fn->getSlot());
+  std::vector<llvm::Value*> args;
+  std::vector<std::pair<FieldAccess*, llvm::Value*> > writeBack;
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    VarDecl* formal = formals->Nth(i);
+    Expr* actual = actuals->Nth(i);
+    llvm::Type* paramTy = formal->getType()->convert();
+    if( !formal->IsByReference() ) {
+      args.push_back(irgen->IRGenerator::CreateConversion(actual->Emit(),
+		paramTy));
+      continue;
+    }
+    llvm::Value* addr = NULL;
+    if( VarExpr* v = dynamic_cast<VarExpr*>(actual) ) {
+      addr = v->EmitAddress();
+    } else if( FieldAccess* f = dynamic_cast<FieldAccess*>(actual) ) {
+      addr = irgen->IRGenerator::CreateEntryAlloca(paramTy, "swizzle.arg");
+      if( formal->getQualifier() == InoutQualifier ) {
+        new llvm::StoreInst(f->Emit(), addr,
+		irgen->IRGenerator::GetBasicBlock());
+      }
+      writeBack.push_back(std::make_pair(f, addr));
+    } else {
+      ReportError::Formatted(actual->GetLocation(),
+		"Argument %d of '%s' must be an l-value", i + 1, field->getName());
+      return NULL;
+    }
+    args.push_back(addr);
+  }
+  llvm::CallInst* call = llvm::CallInst::Create(callee, args, "",
+		irgen->IRGenerator::GetBasicBlock());
+  for( unsigned i = 0; i < writeBack.size(); ++i ) {
+    llvm::Value* val = new llvm::LoadInst(writeBack[i].second, "",
+		irgen->IRGenerator::GetBasicBlock());
+    writeBack[i].first->EmitStore(val);
+  }
+  irgen->IRGenerator::AddCall(call);
+  return call;
+}
+
+/* Built-ins are never real calls; the generator expands them inline. */
+llvm::Value* Call::EmitBuiltin() {
+  std::vector<llvm::Value*> args;
+  for( int i = 0; i < actuals->NumElements(); ++i ) {
+    args.push_back(actuals->Nth(i)->Emit());
+  }
+  //Resolve only lets ints through for the int forms, whose results are int
+  return irgen->IRGenerator::CreateBuiltinCall(field->getName(),
+	staticType == Type::intType, args);
 }
 
  void Call::PrintChildren(int indentLevel) {
@@ -1305,3 +1850,163 @@ Call::Call(yyltype loc, Expr *b, Identifier *f, List<Expr*> *a) : Expr(loc)  {
     if (actuals) actuals->PrintAll(indentLevel+1, "(actuals) ");
  }
  
+
+ConstructorExpr::ConstructorExpr(SourceRange loc, Type *t, List<Expr*> *a)
+  : Expr(loc) {
+    Assert(t != NULL && a != NULL);
+    type = t;
+    (args=a)->SetParentAll(this);
+}
+
+void ConstructorExpr::Resolve() {
+  staticType = type;
+  if( !type->IsScalar() && !type->IsVector() && !type->IsMatrix() ) {
+    ReportError::Formatted(GetLocation(), "Cannot construct a value of type %s",
+		type->getName());
+    staticType = Type::errorType;
+  }
+  for( int i = 0; i < args->NumElements(); ++i ) {
+    args->Nth(i)->Resolve();
+    Type* t = TypeOf(args->Nth(i));
+    if( t == Type::errorType ) {
+      staticType = Type::errorType;
+    } else if( !t->IsScalar() && !t->IsVector() && !t->IsMatrix() ) {
+      ReportError::Formatted(args->Nth(i)->GetLocation(),
+		"Cannot construct %s from %s", type->getName(), t->getName());
+      staticType = Type::errorType;
+    }
+  }
+  if( staticType == Type::errorType ) {
+    return;
+  }
+  //components supplied: 1 per scalar, N per vecN, N*N per matN; the last
+  //argument may run past what is needed, but must start within it
+  int given = 0, lastStart = 0;
+  for( int i = 0; i < args->NumElements(); ++i ) {
+    Type* t = TypeOf(args->Nth(i));
+    lastStart = given;
+    given += t->IsMatrix() ? t->Size() * t->Size() : t->Size();
+  }
+  int needed = type->IsMatrix() ? type->Size() * type->Size() : type->Size();
+  Type* only = args->NumElements() == 1 ? TypeOf(args->Nth(0)) : NULL;
+  if( given == 0 ) {
+    ReportError::Formatted(GetLocation(), "Constructor '%s' needs arguments",
+		type->getName());
+    staticType = Type::errorType;
+  } else if( given < needed && !(only && only->IsScalar()) &&
+	!(only && only->IsMatrix() && type->IsMatrix()) ) {
+    //a lone scalar fills a vector or a matrix diagonal, and a lone
+    //matrix is padded from the identity
+    ReportError::Formatted(GetLocation(),
+		"Too few components to construct '%s'", type->getName());
+    staticType = Type::errorType;
+  } else if( lastStart >= needed ) {
+    ReportError::Formatted(GetLocation(),
+		"Too many components to construct '%s'", type->getName());
+    staticType = Type::errorType;
+  }
+}
+
+bool ConstructorExpr::IsConstant() {
+  for( int i = 0; i < args->NumElements(); ++i ) {
+    if( !args->Nth(i)->IsConstant() ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Arguments are flattened into components (matrices column by column)
+ * and the result is assembled with IRGenerator::BuildVector, so all-
+ * constant constructors fold to constants.
+ */
+llvm::Value* ConstructorExpr::Emit() {
+  TRACE(TraceEmit, "ConstructorExpr");
+  llvm::Type* ty = type->convert();
+  std::vector<llvm::Value*> vals;
+  std::vector<IRGenerator::Component> comps;
+  for( int i = 0; i < args->NumElements(); ++i ) {
+    llvm::Value* v = args->Nth(i)->Emit();
+    vals.push_back(v);
+    llvm::Type* argTy = v->getType();
+    if( argTy->isArrayTy() ) {
+      for( unsigned c = 0; c < argTy->getArrayNumElements(); ++c ) {
+        llvm::Value* col = irgen->IRGenerator::GetColumn(v, c);
+        for( unsigned r = 0; r < col->getType()->getVectorNumElements(); ++r ) {
+          comps.push_back(IRGenerator::Component(col, r));
+        }
+      }
+    } else if( argTy->isVectorTy() ) {
+      for( unsigned r = 0; r < argTy->getVectorNumElements(); ++r ) {
+        comps.push_back(IRGenerator::Component(v, r));
+      }
+    } else {
+      comps.push_back(IRGenerator::Component(v, -1));
+    }
+  }
+  Assert(!comps.empty());
+
+  if( !ty->isVectorTy() && !ty->isArrayTy() ) {
+    //float(v) and friends take the first component
+    llvm::Value* first = comps[0].first;
+    if( comps[0].second >= 0 ) {
+      first = llvm::ExtractElementInst::Create(first,
+		llvm::ConstantInt::get(irgen->IRGenerator::GetIntType(),
+		comps[0].second), "", irgen->IRGenerator::GetBasicBlock());
+    }
+    return irgen->IRGenerator::CreateConversion(first, ty);
+  }
+
+  if( ty->isVectorTy() ) {
+    if( comps.size() == 1 ) {
+      return irgen->IRGenerator::CreateConversion(vals[0], ty);
+    }
+    return irgen->IRGenerator::BuildVector(ty, comps);
+  }
+
+  unsigned n = ty->getArrayNumElements();
+  llvm::Type* colTy = ty->getArrayElementType();
+  llvm::Constant* zero = llvm::ConstantFP::get(
+		irgen->IRGenerator::GetFloatType(), 0.0);
+  llvm::Constant* one = llvm::ConstantFP::get(
+		irgen->IRGenerator::GetFloatType(), 1.0);
+  std::vector<llvm::Value*> cols;
+  if( vals.size() == 1 && !vals[0]->getType()->isVectorTy() ) {
+    if( vals[0]->getType()->isArrayTy() ) {
+      //matN(matM): overlapping part copied, the rest from the identity
+      unsigned m = vals[0]->getType()->getArrayNumElements();
+      for( unsigned c = 0; c < n; ++c ) {
+        std::vector<IRGenerator::Component> col;
+        for( unsigned r = 0; r < n; ++r ) {
+          if( c < m && r < m ) {
+            col.push_back(comps[c * m + r]);
+          } else {
+            col.push_back(IRGenerator::Component(r == c ? one : zero, -1));
+          }
+        }
+        cols.push_back(irgen->IRGenerator::BuildVector(colTy, col));
+      }
+    } else {
+      //matN(s) puts s on the diagonal
+      for( unsigned c = 0; c < n; ++c ) {
+        std::vector<IRGenerator::Component> col;
+        for( unsigned r = 0; r < n; ++r ) {
+          col.push_back(r == c ? comps[0] : IRGenerator::Component(zero, -1));
+        }
+        cols.push_back(irgen->IRGenerator::BuildVector(colTy, col));
+      }
+    }
+    return irgen->IRGenerator::BuildMatrix(ty, cols);
+  }
+  for( unsigned c = 0; c < n; ++c ) {
+    std::vector<IRGenerator::Component> col(comps.begin() + c * n,
+		comps.begin() + (c + 1) * n);
+    cols.push_back(irgen->IRGenerator::BuildVector(colTy, col));
+  }
+  return irgen->IRGenerator::BuildMatrix(ty, cols);
+}
+
+void ConstructorExpr::PrintChildren(int indentLevel) {
+    type->Print(indentLevel+1);
+    args->PrintAll(indentLevel+1, "(args) ");
+}
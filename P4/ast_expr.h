@@ -19,13 +19,27 @@
 
 void yyerror(const char *msg);
 
+class Decl;
+class FnDecl;
+
 class Expr : public Stmt 
 {
+  protected:
+    Type *staticType;	// set by the constructor or Resolve()
+
   public:
-    Expr(yyltype loc) : Stmt(loc) {}
-    Expr() : Stmt() {}
+    Expr(SourceRange loc) : Stmt(loc), staticType(NULL) {}
+    Expr() : Stmt(), staticType(NULL) {}
+    Type *getType() { return staticType; }
     llvm::Value* EmitAddress() {return NULL; }
     llvm::Value* Emit();
+    // after Resolve(): an equivalent, possibly folded, expression. exact
+    // (inside precise) allows only rewrites that keep every bit of the
+    // result
+    virtual Expr* Simplify(bool exact) { return this; }
+    // a literal or a constructor of constants: Emit() gives an
+    // llvm::Constant and inserts no instructions
+    virtual bool IsConstant() { return false; }
 };
 
 class ExprError : public Expr
@@ -52,7 +66,9 @@ class IntConstant : public Expr
     int value;
   
   public:
-    IntConstant(yyltype loc, int val);
+    IntConstant(SourceRange loc, int val);
+    int getValue() { return value; }
+    bool IsConstant() { return true; }
     llvm::Value* Emit();
     const char *GetPrintNameForNode() { return "IntConstant"; }
     void PrintChildren(int indentLevel);
@@ -64,7 +80,9 @@ class FloatConstant: public Expr
     double value;
     
   public:
-    FloatConstant(yyltype loc, double val);
+    FloatConstant(SourceRange loc, double val);
+    double getValue() { return value; }
+    bool IsConstant() { return true; }
     llvm::Value* Emit();
     const char *GetPrintNameForNode() { return "FloatConstant"; }
     void PrintChildren(int indentLevel);
@@ -76,7 +94,9 @@ class BoolConstant : public Expr
     bool value;
     
   public:
-    BoolConstant(yyltype loc, bool val);
+    BoolConstant(SourceRange loc, bool val);
+    bool getValue() { return value; }
+    bool IsConstant() { return true; }
     llvm::Value* Emit();
     const char *GetPrintNameForNode() { return "BoolConstant"; }
     void PrintChildren(int indentLevel);
@@ -86,11 +106,17 @@ class VarExpr : public Expr
 {
   protected:
     Identifier *id;
+    Decl *decl;	// set by Resolve(), NULL if undeclared
 
   public:
     VarExpr(yyltype loc, Identifier *id);
+    Identifier *getId() { return id; }
+    Decl *getDecl() { return decl; }
     llvm::Value* Emit();
     llvm::Value* EmitAddress();
+    void Resolve();
+    Expr* Simplify(bool exact);
+    bool IsConstant();
     const char *GetPrintNameForNode() { return "VarExpr"; }
     void PrintChildren(int indentLevel);
 };
@@ -117,7 +143,14 @@ class CompoundExpr : public Expr
     CompoundExpr(Expr *lhs, Operator *op, Expr *rhs); // for binary
     CompoundExpr(Operator *op, Expr *rhs);             // for unary
     CompoundExpr(Expr *lhs, Operator *op);             // for unary
+    Expr *getLeft() { return left; }
+    Expr *getRight() { return right; }
+    Operator *getOperator() { return op; }
     void PrintChildren(int indentLevel);
+    void Resolve();
+    Expr* Simplify(bool exact);
+    // static type from the already resolved operands; reports misuse
+    virtual Type* Check() = 0;
 };
 
 class ArithmeticExpr : public CompoundExpr 
@@ -128,8 +161,17 @@ class ArithmeticExpr : public CompoundExpr
     llvm::Value* Emit();
     llvm::Value* EmitAddress() { if(left != NULL) return left->EmitAddress();
 				else return right->EmitAddress(); }
-    llvm::Value* comp(llvm::Value* lhs, llvm::Value* rhs, char* oper);
-    llvm::Value* fcomp(llvm::Value* lhs, llvm::Value* rhs, char* oper);
+    static llvm::Value* fold(llvm::Value* lhs, llvm::Value* rhs, char* oper,
+                             bool isFloat);
+    static llvm::Value* comp(llvm::Value* lhs, llvm::Value* rhs, char* oper);
+    static llvm::Value* fcomp(llvm::Value* lhs, llvm::Value* rhs, char* oper);
+    static llvm::Value* mcomp(llvm::Value* lhs, llvm::Value* rhs, Type* l,
+                              Type* r, char* oper);
+    static llvm::Value* binop(llvm::Value* lhs, llvm::Value* rhs, Type* l,
+                              Type* r, char* oper);
+    llvm::Value* EmitContracted();
+    Type* Check();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "ArithmeticExpr"; }
 };
 
@@ -139,6 +181,8 @@ class RelationalExpr : public CompoundExpr
     RelationalExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     llvm::Value* Emit();
     llvm::Value* EmitAddress() { return left->EmitAddress(); }
+    Type* Check();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "RelationalExpr"; }
 };
 
@@ -148,6 +192,8 @@ class EqualityExpr : public CompoundExpr
     EqualityExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     llvm::Value* Emit();
     llvm::Value* EmitAddress() { return left->EmitAddress(); }
+    Type* Check();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "EqualityExpr"; }
 };
 
@@ -158,6 +204,8 @@ class LogicalExpr : public CompoundExpr
     LogicalExpr(Operator *op, Expr *rhs) : CompoundExpr(op,rhs) {}
     llvm::Value* Emit();
     llvm::Value* EmitAddress() { return left->EmitAddress(); }
+    Type* Check();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "LogicalExpr"; }
 };
 
@@ -166,7 +214,11 @@ class AssignExpr : public CompoundExpr
   public:
     AssignExpr(Expr *lhs, Operator *op, Expr *rhs) : CompoundExpr(lhs,op,rhs) {}
     llvm::Value* Emit();
+    llvm::Value* EmitAssign();
+    bool IsPrecise();
     llvm::Value* EmitAddress() { return left->EmitAddress(); }
+    Type* Check();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "AssignExpr"; }
 };
 
@@ -176,13 +228,14 @@ class PostfixExpr : public CompoundExpr
     PostfixExpr(Expr *lhs, Operator *op) : CompoundExpr(lhs,op) {}
     llvm::Value* Emit();
     llvm::Value* EmitAddress() { return left->EmitAddress(); }
+    Type* Check();
     const char *GetPrintNameForNode() { return "PostfixExpr"; }
 };
 
 class LValue : public Expr 
 {
   public:
-    LValue(yyltype loc) : Expr(loc) {}
+    LValue(SourceRange loc) : Expr(loc) {}
 };
 
 class ArrayAccess : public LValue 
@@ -192,6 +245,7 @@ class ArrayAccess : public LValue
     
   public:
     ArrayAccess(yyltype loc, Expr *base, Expr *subscript);
+    void Resolve();
     const char *GetPrintNameForNode() { return "ArrayAccess"; }
     void PrintChildren(int indentLevel);
 };
@@ -211,7 +265,13 @@ class FieldAccess : public LValue
     FieldAccess(Expr *base, Identifier *field); //ok to pass NULL base
     llvm::Value* Emit();
     llvm::Value* EmitAddress();
+    void EmitStore(llvm::Value* val);
+    Expr* ComposeSwizzle(std::vector<int> &mask);
+    static int SwizzleIndex(char c);
     Identifier *getId() { return field; }
+    Expr *getBase() { return base; }
+    void Resolve();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "FieldAccess"; }
     void PrintChildren(int indentLevel);
 };
@@ -226,14 +286,42 @@ class Call : public Expr
     Expr *base;	// will be NULL if no explicit base
     Identifier *field;
     List<Expr*> *actuals;
+    FnDecl *fn;	// set by Resolve(), NULL for built-ins
     
   public:
-    Call() : Expr(), base(NULL), field(NULL), actuals(NULL) {}
+    Call() : Expr(), base(NULL), field(NULL), actuals(NULL), fn(NULL) {}
     Call(yyltype loc, Expr *base, Identifier *field, List<Expr*> *args);
+    llvm::Value* Emit();
+    llvm::Value* EmitBuiltin();
+    Identifier *getField() { return field; }
+    List<Expr*> *getActuals() { return actuals; }
+    FnDecl *getFnDecl() { return fn; }
+    void Resolve();
+    Expr* Simplify(bool exact);
     const char *GetPrintNameForNode() { return "Call"; }
     void PrintChildren(int indentLevel);
 };
 
+/* Constructor expressions vec4(a, b, c, d), vec3(v2, z), mat3(...) and
+ * the scalar conversions float(i), int(f), bool(x). */
+class ConstructorExpr : public Expr
+{
+  protected:
+    Type *type;
+    List<Expr*> *args;
+
+  public:
+    ConstructorExpr(SourceRange loc, Type *type, List<Expr*> *args);
+    Type *getType() { return type; }
+    List<Expr*> *getArgs() { return args; }
+    llvm::Value* Emit();
+    void Resolve();
+    Expr* Simplify(bool exact);
+    bool IsConstant();
+    const char *GetPrintNameForNode() { return "ConstructorExpr"; }
+    void PrintChildren(int indentLevel);
+};
+
 class ActualsError : public Call
 {
   public:
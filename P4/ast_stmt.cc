@@ -8,8 +8,15 @@
 #include "ast_expr.h"
 
 #include "irgen.h"
+#include <limits.h>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include "errors.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/IR/Metadata.h"
 
 Program::Program(List<Decl*> *d) {
     Assert(d != NULL);
@@ -22,9 +29,9 @@ void Program::PrintChildren(int indentLevel) {
 }
 
 llvm::Value* Program::Emit() {
-    if (DEBUG) 
-        Print(0);
-    Node::S = new Symtab();
+    Resolve();
+    if (ReportError::NumErrors() > 0)
+        return NULL;
     // TODO:
     // This is just a reference for you to get started
     //
@@ -32,19 +39,242 @@ llvm::Value* Program::Emit() {
     // for individual node to fill in the module structure and instructions.
     //
     llvm::Module *mod = Node::irgen->GetOrCreateModule("mod");
-    Node::S->enterScope();
+    int threads = GetIntOption("emit-threads", 1);
+    vector<FnDecl*> bodies;
     for (int i = 0; i < decls->NumElements(); i++) {
-        decls->Nth(i)->Emit();
+        FnDecl *f = dynamic_cast<FnDecl*>(decls->Nth(i));
+        if (threads > 1 && f && f->getBody()) {
+            f->EmitPrototype();
+            bodies.push_back(f);
+        } else
+            decls->Nth(i)->Emit();
     }
-    S->exitScope();
-    mod->dump();
-    if (DEBUG)
-        mod->dump();
+    if (!bodies.empty())
+        EmitParallel(threads, bodies);
+    if (TraceOn(TraceIR))
+        mod->print(llvm::outs(), NULL);
     else
         llvm::WriteBitcodeToFile(mod, llvm::outs());
     return NULL;
 }
 
+/* Parallel emission
+ * -----------------
+ * With -femit-threads=N (N > 1) function bodies are resolved and emitted
+ * on N threads. Globals and prototypes are handled first, in order, on
+ * the main thread. Each worker then takes a contiguous run of bodies. It
+ * resolves them against a table stacked on the program scope, which is
+ * read-only by then, and emits into a context of its own. The worker
+ * modules are linked back in worker order, so the output does not depend
+ * on scheduling.
+ */
+static void RunWorkers(int threads, int n,
+                       const function<void(int, int, int)> &work) {
+    vector<thread> pool;
+    for (int t = 0; t < threads && n > 0; t++)
+        pool.push_back(thread(work, t, n * t / threads,
+                              n * (t + 1) / threads));
+    for (unsigned t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+void Program::EmitParallel(int threads, vector<FnDecl*> &bodies) {
+    vector<string> bitcode(threads);
+    RunWorkers(threads, bodies.size(), [&](int t, int begin, int end) {
+        Node::irgen->GetOrCreateModule("mod");
+        for (int i = begin; i < end; i++)
+            bodies[i]->EmitBody(
+                llvm::cast<llvm::Function>(bodies[i]->getSlot()));
+        bitcode[t] = Node::irgen->WriteBitcode();
+        delete Node::irgen;
+        Node::irgen = NULL;
+    });
+    for (int t = 0; t < threads; t++)
+        if (!bitcode[t].empty())
+            Node::irgen->LinkBitcode(bitcode[t]);
+
+    // linking replaces the prototypes with the workers' definitions
+    llvm::Module *mod = Node::irgen->GetOrCreateModule("mod");
+    for (int i = 0; i < decls->NumElements(); i++)
+        if (FnDecl *f = dynamic_cast<FnDecl*>(decls->Nth(i)))
+            f->Bind(mod->getFunction(f->getId()), GLOBAL);
+    vector<llvm::Function*> fns;
+    for (unsigned i = 0; i < bodies.size(); i++)
+        fns.push_back(mod->getFunction(bodies[i]->getId()));
+    Node::irgen->InlineLinkedCalls(fns);
+}
+
+/* Name resolution
+ * ---------------
+ * One walk over the tree before emission binds each VarExpr and Call to
+ * its declaration through the scoped symbol table S. Emission then reads
+ * storage straight off the declaration (Decl::getSlot), so it needs no
+ * scopes of its own.
+ */
+void Program::Resolve() {
+    Node::S = new Symtab();
+    Node::S->enterScope();
+    int threads = GetIntOption("emit-threads", 1);
+    vector<FnDecl*> bodies;
+    vector<size_t> marks;
+    for (int i = 0; i < decls->NumElements() &&
+                    !ReportError::LimitReached(); i++) {
+        FnDecl *f = dynamic_cast<FnDecl*>(decls->Nth(i));
+        if (threads > 1 && f && f->getBody()) {
+            f->Declare();
+            bodies.push_back(f);
+            marks.push_back(Node::S->getMark());
+        } else
+            decls->Nth(i)->Resolve();
+    }
+    Symtab *program = Node::S;
+    RunWorkers(threads, bodies.size(), [&](int, int begin, int end) {
+        for (int i = begin; i < end && !ReportError::LimitReached(); i++) {
+            // sees exactly the globals declared before the function
+            Node::S = new Symtab(program, marks[i]);
+            bodies[i]->ResolveBody();
+            delete Node::S;
+        }
+    });
+    Node::S->exitScope();
+}
+
+// simplifies the operands of a statement expression in place; its own
+// value is unused
+static void SimplifyStmt(Stmt *s) {
+    if (Expr *e = dynamic_cast<Expr*>(s))
+        e->Simplify(false);
+}
+
+// a function's outermost block shares the scope of its formals
+void StmtBlock::Resolve() {
+    bool scoped = dynamic_cast<FnDecl*>(GetParent()) == NULL;
+    if (scoped)
+        Node::S->enterScope();
+    for (int i = 0; i < decls->NumElements(); i++)
+        decls->Nth(i)->Resolve();
+    for (int i = 0; i < stmts->NumElements(); i++) {
+        stmts->Nth(i)->Resolve();
+        SimplifyStmt(stmts->Nth(i));
+    }
+    if (scoped)
+        Node::S->exitScope();
+}
+
+// an ill-typed test has already been reported
+static void CheckTest(Expr *test) {
+    Type *t = test->getType();
+    if (t && t != Type::errorType && t != Type::boolType)
+        ReportError::TestNotBoolean(test);
+}
+
+void DeclStmt::Resolve() {
+    decl->Resolve();
+}
+
+void ForStmt::Resolve() {
+    Node::S->enterScope();
+    init->Resolve();
+    SimplifyStmt(init);
+    test->Resolve();
+    CheckTest(test);
+    (test = test->Simplify(false))->SetParent(this);
+    if (step) {
+        step->Resolve();
+        SimplifyStmt(step);
+    }
+    body->Resolve();
+    SimplifyStmt(body);
+    Node::S->exitScope();
+}
+
+void WhileStmt::Resolve() {
+    Node::S->enterScope();
+    test->Resolve();
+    CheckTest(test);
+    (test = test->Simplify(false))->SetParent(this);
+    body->Resolve();
+    SimplifyStmt(body);
+    Node::S->exitScope();
+}
+
+void IfStmt::Resolve() {
+    Node::S->enterScope();
+    test->Resolve();
+    CheckTest(test);
+    (test = test->Simplify(false))->SetParent(this);
+    body->Resolve();
+    SimplifyStmt(body);
+    if (elseBody) {
+        elseBody->Resolve();
+        SimplifyStmt(elseBody);
+    }
+    Node::S->exitScope();
+}
+
+void ReturnStmt::Resolve() {
+    if (expr) {
+        expr->Resolve();
+        (expr = expr->Simplify(false))->SetParent(this);
+    }
+    Node *n = GetParent();
+    while (n && dynamic_cast<FnDecl*>(n) == NULL)
+        n = n->GetParent();
+    if (n == NULL)
+        return;
+    Type *expected = static_cast<FnDecl*>(n)->getReturnType();
+    Type *given = expr ? expr->getType() : Type::voidType;
+    if (given && given != Type::errorType && given != expected)
+        ReportError::ReturnMismatch(this, given, expected);
+}
+
+// a case label must fold to an int literal, so "case -1:" and
+// "case 2*3:" are fine
+void SwitchLabel::Resolve() {
+    if (label) {
+        label->Resolve();
+        (label = label->Simplify(false))->SetParent(this);
+        if (label->getType() != Type::errorType &&
+            dynamic_cast<IntConstant*>(label) == NULL)
+            ReportError::Formatted(label->GetLocation(),
+                "case label is not a constant integer");
+    }
+    if (stmt) {
+        stmt->Resolve();
+        SimplifyStmt(stmt);
+    }
+}
+
+void SwitchStmt::Resolve() {
+    expr->Resolve();
+    Type *t = expr->getType();
+    if (t != Type::errorType && t != Type::intType)
+        ReportError::Formatted(expr->GetLocation(),
+            "Switch expression must have int type");
+    (expr = expr->Simplify(false))->SetParent(this);
+    Node::S->enterScope();
+    for (int i = 0; i < cases->NumElements(); i++)
+        cases->Nth(i)->Resolve();
+    if (def)
+        def->Resolve();
+    Node::S->exitScope();
+
+    // labels are folded by now; runs of labels nest in the grammar
+    vector<int> values;
+    for (int i = 0; i < cases->NumElements(); i++)
+        for (Stmt *st = cases->Nth(i);
+             SwitchLabel *l = dynamic_cast<SwitchLabel*>(st);
+             st = l->getStmt())
+            if (IntConstant *n = dynamic_cast<IntConstant*>(l->getLabel()))
+                values.push_back(n->getValue());
+    std::sort(values.begin(), values.end());
+    for (unsigned i = 1; i < values.size(); i++)
+        if (values[i] == values[i - 1] &&
+            (i == 1 || values[i - 2] != values[i]))
+            ReportError::Formatted(GetLocation(), "duplicate case value %d",
+                values[i]);
+}
+
 StmtBlock::StmtBlock(List<VarDecl*> *d, List<Stmt*> *s) {
     Assert(d != NULL && s != NULL);
     (decls=d)->SetParentAll(this);
@@ -147,109 +377,522 @@ void SwitchStmt::PrintChildren(int indentLevel) {
 }
 
 llvm::Value* StmtBlock::Emit() {
-    if (DEBUG)
-        cout << "StmtBlock" << endl;
+    TRACE(TraceEmit, "StmtBlock");
     for (int i = 0; i < decls->NumElements(); i++) {
         decls->Nth(i)->Emit();
     }
     for (int i = 0; i < stmts->NumElements(); i++) {
         if (!Node::irgen->GetBasicBlock()->getTerminator())
             stmts->Nth(i)->Emit();
-        else if ( DEBUG )
-            cout << Node::irgen->GetBasicBlock()->getName().str() << endl;
+        else
+            TRACE(TraceEmit, "unreachable statement after %s",
+                  Node::irgen->GetBasicBlock()->getName().str().c_str());
     }
     return NULL;
 }
 
 llvm::Value* DeclStmt::Emit() {
-    if (DEBUG)
-        cout << "DeclStmt" << endl;
+    TRACE(TraceEmit, "DeclStmt");
     decl->Emit();
     return NULL;
 }
 
-llvm::Value* ForStmt::Emit() {
-    Node::S->enterScope();
-    if (DEBUG)
-        cout << "ForStmt" << endl;
+/* Loop pragmas
+ * ------------
+ * #pragma unroll, #pragma unroll(N), #pragma nounroll and #pragma
+ * vectorize in front of a loop end up as llvm.loop metadata on its latch.
+ * Anything else is ignored, as GLSL requires for unknown pragmas.
+ */
+void LoopStmt::AddPragma(const char *text) {
+    int count;
+    if (sscanf(text, "unroll ( %d )", &count) == 1 && count > 0)
+        unrollCount = count;
+    else if (strncmp(text, "unroll", 6) == 0 && strchr(text, '(') == NULL)
+        unrollCount = FullUnroll;
+    else if (strncmp(text, "nounroll", 8) == 0)
+        unrollCount = NoUnroll;
+    else if (strncmp(text, "vectorize", 9) == 0)
+        vectorize = true;
+    else
+        TRACE(TraceLoops, "ignoring #pragma %s", text);
+}
+
+static llvm::Metadata *LoopHint(llvm::LLVMContext &ctx, const char *name,
+                                llvm::Constant *value = NULL) {
+    llvm::SmallVector<llvm::Metadata *, 2> ops;
+    ops.push_back(llvm::MDString::get(ctx, name));
+    if (value)
+        ops.push_back(llvm::ConstantAsMetadata::get(value));
+    return llvm::MDNode::get(ctx, ops);
+}
+
+// the loop id is a distinct node whose first operand is itself
+void LoopStmt::AttachLoopMetadata(llvm::BranchInst *latch) {
+    llvm::LLVMContext &ctx = *Node::irgen->GetContext();
+    llvm::SmallVector<llvm::Metadata *, 4> ops;
+    llvm::TempMDTuple self = llvm::MDNode::getTemporary(ctx, llvm::None);
+    ops.push_back(self.get());
+    if (unrollCount == FullUnroll)
+        ops.push_back(LoopHint(ctx, "llvm.loop.unroll.full"));
+    else if (unrollCount == NoUnroll)
+        ops.push_back(LoopHint(ctx, "llvm.loop.unroll.disable"));
+    else if (unrollCount > 0)
+        ops.push_back(LoopHint(ctx, "llvm.loop.unroll.count",
+            llvm::ConstantInt::get(Node::irgen->GetIntType(), unrollCount)));
+    if (vectorize)
+        ops.push_back(LoopHint(ctx, "llvm.loop.vectorize.enable",
+            llvm::ConstantInt::get(Node::irgen->GetBoolType(), 1)));
+    llvm::MDNode *loopID = llvm::MDNode::get(ctx, ops);
+    loopID->replaceOperandWith(0, loopID);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loopID);
+}
+
+/* Loops are emitted in rotated form:
+ *
+ *   guard:     cond = test; br cond, preheader, exit
+ *   preheader: br body
+ *   body:      ...; br latch
+ *   latch:     step; cond = test; br cond, body, exit   !llvm.loop
+ *   exit:
+ *
+ * Blocks are created detached and appended as emission reaches them, so
+ * the function's block list is already in program order. continue goes
+ * to the latch, break to the exit.
+ */
+void LoopStmt::EmitRotated(Expr *step, const char *kind) {
     llvm::LLVMContext *context = Node::irgen->GetContext();
     llvm::Function *f = Node::irgen->GetFunction();
     llvm::BasicBlock *pbb = Node::breakB;
     llvm::BasicBlock *pcb = Node::continueB;
-    init->Emit();
-    llvm::BasicBlock *hb = Node::irgen->GetBasicBlock();
-    llvm::BasicBlock *bb = llvm::BasicBlock::Create(*context, "for body", f);
-    llvm::BasicBlock *fb = llvm::BasicBlock::Create(*context, "for footer", f);
-    llvm::BasicBlock *sb = llvm::BasicBlock::Create(*context, "for step", f);
-    llvm::BranchInst::Create(bb, fb, test->Emit(), hb);
-    Node::breakB = fb;
-    Node::continueB = sb;
-    bb->moveAfter(Node::irgen->GetBasicBlock());
+    string k(kind);
+    llvm::BasicBlock *ph = llvm::BasicBlock::Create(*context, k + " preheader");
+    llvm::BasicBlock *bb = llvm::BasicBlock::Create(*context, k + " body");
+    llvm::BasicBlock *lb = llvm::BasicBlock::Create(*context, k + " latch");
+    llvm::BasicBlock *fb = llvm::BasicBlock::Create(*context, k + " footer");
+
+    llvm::BranchInst::Create(ph, fb, test->Emit(), Node::irgen->GetBasicBlock());
+    ph->insertInto(f);
+    llvm::BranchInst::Create(bb, ph);
+
+    bb->insertInto(f);
     Node::irgen->SetBasicBlock(bb);
+    Node::breakB = fb;
+    Node::continueB = lb;
     body->Emit();
-    if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-        llvm::BranchInst::Create(sb, Node::irgen->GetBasicBlock());
-    }
-    sb->moveAfter(Node::irgen->GetBasicBlock());
-    Node::irgen->SetBasicBlock(sb);
-    step->Emit();
-    if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-        llvm::BranchInst::Create(bb, fb, test->Emit(), Node::irgen->GetBasicBlock());
-    }
-    fb->moveAfter(Node::irgen->GetBasicBlock());
-    if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-        llvm::BranchInst::Create(sb, Node::irgen->GetBasicBlock());
-    }
+    if (!Node::irgen->GetBasicBlock()->getTerminator())
+        llvm::BranchInst::Create(lb, Node::irgen->GetBasicBlock());
+
+    lb->insertInto(f);
+    Node::irgen->SetBasicBlock(lb);
+    // the step's int arithmetic goes through CreateIntOp, which decides
+    // on nsw like everywhere else
+    if (step)
+        step->Emit();
+    llvm::BranchInst *latch = llvm::BranchInst::Create(bb, fb, test->Emit(),
+        Node::irgen->GetBasicBlock());
+    AttachLoopMetadata(latch);
+
+    fb->insertInto(f);
     Node::irgen->SetBasicBlock(fb);
-    Node::S->exitScope();
     Node::breakB = pbb;
     Node::continueB = pcb;
+}
+
+/* Full unrolling
+ * --------------
+ * for (i = A; i op B; i++ / i-- / i += C / i -= C) with integer literals
+ * A, B and C is emitted as one copy of the body per iteration, each with
+ * i bound to its constant value (symbol flag CONSTANT), so arithmetic and
+ * conditions on i fold while the body is emitted. The body may not write
+ * i, pass it to a user function, or break/continue out of this loop, and
+ * i must be a local that is not an out/inout formal.
+ * trips * body size must fit -funroll-budget (default 128); #pragma unroll
+ * lifts the budget and #pragma nounroll / unroll(N) turn this off.
+ */
+static const int DefaultUnrollBudget = 128;
+static const int MaxUnrollTrips = 1024;
+
+static bool IsVar(Expr *e, const char *name) {
+    VarExpr *v = dynamic_cast<VarExpr*>(e);
+    return v && strcmp(v->getId()->getName(), name) == 0;
+}
+
+// true if e leaves iv alone; counts nodes into size
+static bool KeepsVar(Expr *e, const char *iv, int &size) {
+    if (!e)
+        return true;
+    size++;
+    if (AssignExpr *a = dynamic_cast<AssignExpr*>(e)) {
+        if (IsVar(a->getLeft(), iv))
+            return false;
+        return KeepsVar(a->getLeft(), iv, size) &&
+               KeepsVar(a->getRight(), iv, size);
+    }
+    if (CompoundExpr *c = dynamic_cast<CompoundExpr*>(e)) {
+        const char *op = c->getOperator()->getOp();
+        bool incdec = !strcmp(op, "++") || !strcmp(op, "--");
+        if (incdec && (IsVar(c->getLeft(), iv) || IsVar(c->getRight(), iv)))
+            return false;
+        return KeepsVar(c->getLeft(), iv, size) &&
+               KeepsVar(c->getRight(), iv, size);
+    }
+    if (FieldAccess *f = dynamic_cast<FieldAccess*>(e))
+        return KeepsVar(f->getBase(), iv, size);
+    if (ConstructorExpr *k = dynamic_cast<ConstructorExpr*>(e)) {
+        for (int i = 0; i < k->getArgs()->NumElements(); i++)
+            if (!KeepsVar(k->getArgs()->Nth(i), iv, size))
+                return false;
+        return true;
+    }
+    if (Call *c = dynamic_cast<Call*>(e)) {
+        for (int i = 0; i < c->getActuals()->NumElements(); i++) {
+            Expr *arg = c->getActuals()->Nth(i);
+            if (IsVar(arg, iv) || !KeepsVar(arg, iv, size))
+                return false;
+        }
+        return true;
+    }
+    return true;
+}
+
+static bool IsUnrollable(Stmt *s, const char *iv, int &size, int loops,
+                         int switches) {
+    if (!s)
+        return true;
+    if (Expr *e = dynamic_cast<Expr*>(s))
+        return KeepsVar(e, iv, size);
+    size++;
+    if (StmtBlock *b = dynamic_cast<StmtBlock*>(s)) {
+        for (int i = 0; i < b->getStmts()->NumElements(); i++)
+            if (!IsUnrollable(b->getStmts()->Nth(i), iv, size, loops, switches))
+                return false;
+        return true;
+    }
+    if (DeclStmt *d = dynamic_cast<DeclStmt*>(s)) {
+        VarDecl *v = dynamic_cast<VarDecl*>(d->getDecl());
+        // a copy of i would have to shadow the bound constant
+        return v && strcmp(v->getId(), iv) != 0;
+    }
+    if (IfStmt *i = dynamic_cast<IfStmt*>(s))
+        return KeepsVar(i->getTest(), iv, size) &&
+               IsUnrollable(i->getBody(), iv, size, loops, switches) &&
+               IsUnrollable(i->getElseBody(), iv, size, loops, switches);
+    if (ForStmt *f = dynamic_cast<ForStmt*>(s))
+        return KeepsVar(f->getInit(), iv, size) &&
+               KeepsVar(f->getTest(), iv, size) &&
+               KeepsVar(f->getStep(), iv, size) &&
+               IsUnrollable(f->getBody(), iv, size, loops + 1, switches);
+    if (WhileStmt *w = dynamic_cast<WhileStmt*>(s))
+        return KeepsVar(w->getTest(), iv, size) &&
+               IsUnrollable(w->getBody(), iv, size, loops + 1, switches);
+    if (SwitchStmt *sw = dynamic_cast<SwitchStmt*>(s)) {
+        if (!KeepsVar(sw->getExpr(), iv, size))
+            return false;
+        for (int i = 0; i < sw->getCases()->NumElements(); i++)
+            if (!IsUnrollable(sw->getCases()->Nth(i), iv, size, loops,
+                              switches + 1))
+                return false;
+        return true;
+    }
+    if (SwitchLabel *l = dynamic_cast<SwitchLabel*>(s))
+        return IsUnrollable(l->getStmt(), iv, size, loops, switches);
+    if (dynamic_cast<BreakStmt*>(s))
+        return loops > 0 || switches > 0;
+    if (dynamic_cast<ContinueStmt*>(s))
+        return loops > 0;
+    if (ReturnStmt *r = dynamic_cast<ReturnStmt*>(s))
+        return KeepsVar(r->getExpr(), iv, size);
+    return false;
+}
+
+// sets holds to v op bound; false if op is not a comparison we know
+static bool TestHolds(const char *op, int v, int bound, bool &holds) {
+    if (!strcmp(op, "<"))       holds = v < bound;
+    else if (!strcmp(op, "<=")) holds = v <= bound;
+    else if (!strcmp(op, ">"))  holds = v > bound;
+    else if (!strcmp(op, ">=")) holds = v >= bound;
+    else if (!strcmp(op, "==")) holds = v == bound;
+    else if (!strcmp(op, "!=")) holds = v != bound;
+    else return false;
+    return true;
+}
+
+bool ForStmt::EmitUnrolled() {
+    if (unrollCount == NoUnroll || unrollCount > 0)
+        return false;
+    AssignExpr *a = dynamic_cast<AssignExpr*>(init);
+    if (!a || strcmp(a->getOperator()->getOp(), "=") != 0)
+        return false;
+    VarExpr *iv = dynamic_cast<VarExpr*>(a->getLeft());
+    IntConstant *start = dynamic_cast<IntConstant*>(a->getRight());
+    CompoundExpr *t = dynamic_cast<CompoundExpr*>(test);
+    CompoundExpr *st = dynamic_cast<CompoundExpr*>(step);
+    if (!iv || !start || !t || !st)
+        return false;
+    const char *name = iv->getId()->getName();
+    IntConstant *bound = dynamic_cast<IntConstant*>(t->getRight());
+    if (!IsVar(t->getLeft(), name) || !bound)
+        return false;
+
+    // 64-bit so negating INT_MIN or stepping past INT_MAX cannot overflow
+    long long stride;
+    const char *sop = st->getOperator()->getOp();
+    Expr *target = st->getLeft() ? st->getLeft() : st->getRight();
+    if (!IsVar(target, name))
+        return false;
+    if (!strcmp(sop, "++"))
+        stride = 1;
+    else if (!strcmp(sop, "--"))
+        stride = -1;
+    else if ((!strcmp(sop, "+=") || !strcmp(sop, "-=")) &&
+             dynamic_cast<IntConstant*>(st->getRight()))
+        stride = (long long) dynamic_cast<IntConstant*>(st->getRight())->getValue() *
+                 (sop[0] == '+' ? 1 : -1);
+    else
+        return false;
+
+    VarDecl *ivd = dynamic_cast<VarDecl*>(iv->getDecl());
+    // only a plain local: a callee could read a global or the caller's
+    // variable behind an out/inout formal, and neither may be rebound
+    // from one worker thread while others emit
+    if (!ivd || ivd->getStorage() != LOCAL || ivd->IsByReference() ||
+        strcmp(ivd->getType()->getName(), "int") != 0)
+        return false;
+
+    vector<int> values;
+    int v = start->getValue();
+    const char *top = t->getOperator()->getOp();
+    bool holds;
+    while (true) {
+        if (!TestHolds(top, v, bound->getValue(), holds))
+            return false;
+        if (!holds)
+            break;
+        if ((int) values.size() == MaxUnrollTrips)
+            return false;
+        values.push_back(v);
+        // the run-time loop would wrap here; leave it to EmitRotated
+        if (v + stride < INT_MIN || v + stride > INT_MAX)
+            return false;
+        v += stride;
+    }
+    int size = 0;
+    if (!IsUnrollable(body, name, size, 0, 0))
+        return false;
+    int budget = GetIntOption("unroll-budget", DefaultUnrollBudget);
+    if (unrollCount != FullUnroll && (int) values.size() * size > budget)
+        return false;
+    TRACE(TraceLoops, "ForStmt unrolled %d times", (int) values.size());
+
+    llvm::Value *slot = ivd->getSlot();
+    int storage = ivd->getStorage();
+    for (unsigned i = 0; i < values.size(); i++) {
+        if (Node::irgen->GetBasicBlock()->getTerminator())
+            break;
+        ivd->Bind(llvm::ConstantInt::get(Node::irgen->GetIntType(), values[i]),
+                  CONSTANT);
+        body->Emit();
+    }
+    ivd->Bind(slot, storage);
+    // i keeps the value it would have after the loop
+    if (!Node::irgen->GetBasicBlock()->getTerminator())
+        new llvm::StoreInst(llvm::ConstantInt::get(Node::irgen->GetIntType(), v),
+                            slot, Node::irgen->GetBasicBlock());
+    return true;
+}
+
+llvm::Value* ForStmt::Emit() {
+    TRACE(TraceEmit, "ForStmt");
+    if (EmitUnrolled())
+        return NULL;
+    init->Emit();
+    EmitRotated(step, "for");
     return NULL;
 }
 
 llvm::Value* WhileStmt::Emit() {
-    Node::S->enterScope();
-    if (DEBUG)
-        cout << "WhileStmt" << endl;
-    llvm::BasicBlock *pbb = Node::breakB;
-    llvm::BasicBlock *pcb = Node::continueB;
-    llvm::Function *f = Node::irgen->GetFunction();
-    llvm::LLVMContext *context = Node::irgen->GetContext();
-    llvm::BasicBlock *hb = Node::irgen->GetBasicBlock();
-    llvm::BasicBlock *tb = llvm::BasicBlock::Create(*context, "while test", f);
-    llvm::BasicBlock *bb = llvm::BasicBlock::Create(*context, "while body", f);
-    llvm::BasicBlock *fb = llvm::BasicBlock::Create(*context, "while footer", f);
-    Node::breakB = fb;
-    Node::continueB = tb;
-    if (!hb->getTerminator()) {
-        llvm::BranchInst::Create(tb, hb);
+    TRACE(TraceEmit, "WhileStmt");
+    EmitRotated(NULL, "while");
+    return NULL;
+}
+
+/* If-conversion
+ * -------------
+ * An if whose branches only assign side-effect-free expressions to plain
+ * variables is emitted without branches: both sides are evaluated and
+ * each target gets a select. The summed operation count of both branches
+ * must stay within -fif-convert-cost (default 8, 0 turns it off).
+ */
+static const int DefaultIfConvertCost = 8;
+
+static bool IsFloatOperand(Expr *e) {
+    Type *t = e->getType();
+    return t && (t == Type::floatType || t->IsVector() || t->IsMatrix());
+}
+
+// true if e can be evaluated unconditionally; adds its operations to cost
+// and the variables it reads to reads
+static bool IsSpeculatable(Expr *e, int &cost, set<string> &reads) {
+    if (dynamic_cast<IntConstant*>(e) || dynamic_cast<FloatConstant*>(e) ||
+        dynamic_cast<BoolConstant*>(e))
+        return true;
+    if (VarExpr *v = dynamic_cast<VarExpr*>(e)) {
+        reads.insert(v->getId()->getName());
+        return true;
     }
-    tb->moveAfter(Node::irgen->GetBasicBlock());
-    Node::irgen->SetBasicBlock(tb);
-    if (!tb->getTerminator()) {
-        llvm::BranchInst::Create(bb, fb, test->Emit(), tb);
+    if (FieldAccess *f = dynamic_cast<FieldAccess*>(e)) {
+        cost++;
+        return f->getBase() && IsSpeculatable(f->getBase(), cost, reads);
     }
-    bb->moveAfter(tb);
-    Node::irgen->SetBasicBlock(bb);   
-    body->Emit();
-    if (!bb->getTerminator()) {
-        llvm::BranchInst::Create(tb, bb);
+    if (ConstructorExpr *c = dynamic_cast<ConstructorExpr*>(e)) {
+        cost++;
+        for (int i = 0; i < c->getArgs()->NumElements(); i++)
+            if (!IsSpeculatable(c->getArgs()->Nth(i), cost, reads))
+                return false;
+        return true;
     }
-    fb->moveAfter(Node::irgen->GetBasicBlock());
-    if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-        llvm::BranchInst::Create(tb, Node::irgen->GetBasicBlock());
+    if (Call *c = dynamic_cast<Call*>(e)) {
+        // only built-ins are known to be pure
+        const char *name = c->getField()->getName();
+        if (c->getFnDecl() || IRGenerator::GetBuiltinArity(name) < 0)
+            return false;
+        cost += 2;
+        for (int i = 0; i < c->getActuals()->NumElements(); i++)
+            if (!IsSpeculatable(c->getActuals()->Nth(i), cost, reads))
+                return false;
+        return true;
     }
-    Node::irgen->SetBasicBlock(fb);
-    Node::S->exitScope();
-    Node::breakB = pbb;
-    Node::continueB = pcb;
-    return NULL;
+    if (dynamic_cast<AssignExpr*>(e) || dynamic_cast<PostfixExpr*>(e))
+        return false;
+    if (CompoundExpr *c = dynamic_cast<CompoundExpr*>(e)) {
+        const char *op = c->getOperator()->getOp();
+        if (!strcmp(op, "++") || !strcmp(op, "--"))
+            return false;
+        // integer division by zero traps, so only float division is hoisted
+        if (!strcmp(op, "/") && !IsFloatOperand(c->getRight()))
+            return false;
+        cost++;
+        if (c->getLeft() && !IsSpeculatable(c->getLeft(), cost, reads))
+            return false;
+        return IsSpeculatable(c->getRight(), cost, reads);
+    }
+    return false;
+}
+
+// gathers the "var = expr" statements of a branch; fails on anything else,
+// on a target assigned twice and on a read of an earlier target
+static bool CollectAssigns(Stmt *s, vector<AssignExpr*> &assigns, int &cost) {
+    if (!s)
+        return true;
+    if (StmtBlock *b = dynamic_cast<StmtBlock*>(s)) {
+        if (b->getDecls()->NumElements() > 0)
+            return false;
+        for (int i = 0; i < b->getStmts()->NumElements(); i++)
+            if (!CollectAssigns(b->getStmts()->Nth(i), assigns, cost))
+                return false;
+        return true;
+    }
+    AssignExpr *a = dynamic_cast<AssignExpr*>(s);
+    if (!a || strcmp(a->getOperator()->getOp(), "=") != 0)
+        return false;
+    VarExpr *target = dynamic_cast<VarExpr*>(a->getLeft());
+    if (!target)
+        return false;
+    // select cannot pick between matrices
+    if (target->getType()->IsMatrix())
+        return false;
+    set<string> reads;
+    if (!IsSpeculatable(a->getRight(), cost, reads))
+        return false;
+    for (unsigned i = 0; i < assigns.size(); i++) {
+        string prev =
+            dynamic_cast<VarExpr*>(assigns[i]->getLeft())->getId()->getName();
+        if (prev == target->getId()->getName() || reads.count(prev))
+            return false;
+    }
+    assigns.push_back(a);
+    return true;
+}
+
+static string TargetName(AssignExpr *a) {
+    return dynamic_cast<VarExpr*>(a->getLeft())->getId()->getName();
+}
+
+// an assignment's value, in a precise region if its target is precise
+static llvm::Value *EmitRight(AssignExpr *a) {
+    if (!a->IsPrecise())
+        return a->getRight()->Emit();
+    Node::irgen->BeginPrecise();
+    llvm::Value *v = a->getRight()->Emit();
+    Node::irgen->EndPrecise();
+    return v;
+}
+
+bool IfStmt::EmitSelect(llvm::Value *cond) {
+    int limit = GetIntOption("if-convert-cost", DefaultIfConvertCost);
+    vector<AssignExpr*> thenA, elseA;
+    int cost = 0;
+    if (limit <= 0 || !CollectAssigns(body, thenA, cost) ||
+        !CollectAssigns(elseBody, elseA, cost) || cost > limit ||
+        thenA.size() + elseA.size() == 0)
+        return false;
+    TRACE(TraceEmit, "IfStmt select, cost %d", cost);
+
+    vector<llvm::Value*> thenV, elseV;
+    for (unsigned i = 0; i < thenA.size(); i++)
+        thenV.push_back(EmitRight(thenA[i]));
+    for (unsigned i = 0; i < elseA.size(); i++)
+        elseV.push_back(EmitRight(elseA[i]));
+    llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
+
+    // every target in first-assignment order, then/else value or NULL
+    vector<VarExpr*> targets;
+    vector<llvm::Value*> tv, ev;
+    for (unsigned i = 0; i < thenA.size(); i++) {
+        targets.push_back(dynamic_cast<VarExpr*>(thenA[i]->getLeft()));
+        tv.push_back(thenV[i]);
+        ev.push_back(NULL);
+    }
+    for (unsigned i = 0; i < elseA.size(); i++) {
+        unsigned j = 0;
+        while (j < targets.size() &&
+               targets[j]->getId()->getName() != TargetName(elseA[i]))
+            j++;
+        if (j == targets.size()) {
+            targets.push_back(dynamic_cast<VarExpr*>(elseA[i]->getLeft()));
+            tv.push_back(NULL);
+            ev.push_back(NULL);
+        }
+        ev[j] = elseV[i];
+    }
+
+    for (unsigned i = 0; i < targets.size(); i++) {
+        llvm::Value *addr = targets[i]->EmitAddress();
+        llvm::Type *ty =
+            llvm::cast<llvm::PointerType>(addr->getType())->getElementType();
+        llvm::Value *old = NULL;
+        if (!tv[i] || !ev[i])
+            old = new llvm::LoadInst(addr, "", bb);
+        llvm::Value *t = tv[i] ? Node::irgen->CreateConversion(tv[i], ty) : old;
+        llvm::Value *e = ev[i] ? Node::irgen->CreateConversion(ev[i], ty) : old;
+        llvm::Value *sel = llvm::SelectInst::Create(cond, t, e, "", bb);
+        new llvm::StoreInst(sel, addr, bb);
+    }
+    return true;
 }
 
 llvm::Value* IfStmt::Emit() {
-    Node::S->enterScope();
-    if (DEBUG)
-        cout << "IfStmt" << endl;
+    TRACE(TraceEmit, "IfStmt");
+    llvm::Value *cond = test->Emit();
+    if (llvm::ConstantInt *known = llvm::dyn_cast<llvm::ConstantInt>(cond)) {
+        // e.g. a test on an unrolled loop index: only one side is live
+        Stmt *taken = known->isOne() ? body : elseBody;
+        if (taken)
+            taken->Emit();
+        return NULL;
+    }
+    if (EmitSelect(cond))
+        return NULL;
     llvm::LLVMContext *context = Node::irgen->GetContext();
     llvm::Function *f = Node::irgen->GetFunction();
     llvm::BasicBlock *hb = Node::irgen->GetBasicBlock();
@@ -258,7 +901,7 @@ llvm::Value* IfStmt::Emit() {
     if (elseBody)
         eb = llvm::BasicBlock::Create(*context, "else", f);
     llvm::BasicBlock *fb = llvm::BasicBlock::Create(*context, "if footer", f);
-    llvm::BranchInst::Create(tb, elseBody ? eb : fb, test->Emit(), hb);
+    llvm::BranchInst::Create(tb, elseBody ? eb : fb, cond, hb);
     tb->moveAfter(hb);
     Node::irgen->SetBasicBlock(tb);
     body->Emit();
@@ -282,86 +925,187 @@ llvm::Value* IfStmt::Emit() {
         llvm::BranchInst::Create(fb, Node::irgen->GetBasicBlock());
     }
     Node::irgen->SetBasicBlock(fb);
-    Node::S->exitScope();
     return NULL;
 }
 
+/* SwitchStmt dispatches on the labels and emits the statements they
+ * guard itself; a label on its own just emits its statement.
+ */
 llvm::Value* Case::Emit() {
-    if (DEBUG)
-        cout << "SwitchLabel" << endl;
-    llvm::LLVMContext *context = Node::irgen->GetContext();
-    llvm::Function *f = Node::irgen->GetFunction();
-    llvm::BasicBlock *switchB = Node::irgen->GetBasicBlock();
-    llvm::BasicBlock *caseB = llvm::BasicBlock::Create(*context, "case", f);
-    if (!switchB->getTerminator()) {
-        llvm::BranchInst::Create(caseB, switchB);
-    }
-    Node::irgen->SetBasicBlock(caseB);
+    TRACE(TraceEmit, "SwitchLabel");
     stmt->Emit();
-    Node::switchI->llvm::SwitchInst::addCase(llvm::cast<llvm::ConstantInt>(label->Emit()), caseB);
     return NULL;
 }
 
 llvm::Value* Default::Emit() {
-    if (DEBUG)
-        cout << "Default" << endl;
-    llvm::LLVMContext *context = Node::irgen->GetContext();
-    llvm::Function *f = Node::irgen->GetFunction();
-    llvm::BasicBlock *defaultB = llvm::BasicBlock::Create(*context, "default", f);
-    defaultB->moveAfter(Node::irgen->GetBasicBlock());
-    Node::switchI->getDefaultDest()->removeFromParent();
-    if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-        llvm::BranchInst::Create(defaultB, Node::irgen->GetBasicBlock());
-    }
-    Node::irgen->SetBasicBlock(defaultB);
+    TRACE(TraceEmit, "Default");
     stmt->Emit();
-    Node::switchI->setDefaultDest(defaultB);
     return NULL;
 }
 
+/* Switch lowering
+ * ---------------
+ * The sorted case values are split into clusters: runs with at least
+ * MinJumpTableCases labels filling at least half of their value range
+ * become a jump table (one range check, then an llvm switch over just
+ * that range), every other label is a cluster of its own. The clusters
+ * are dispatched through a balanced binary search tree of signed
+ * compares, so sparse labels cost O(log n) tests.
+ */
+static const unsigned MinJumpTableCases = 4;
+
+struct SwitchCluster {
+    int64_t lo, hi;
+    vector<pair<llvm::ConstantInt*, llvm::BasicBlock*> > cases;
+};
+
+static bool CaseLess(const pair<llvm::ConstantInt*, llvm::BasicBlock*> &a,
+                     const pair<llvm::ConstantInt*, llvm::BasicBlock*> &b) {
+    return a.first->getSExtValue() < b.first->getSExtValue();
+}
+
+static void BuildClusters(
+        vector<pair<llvm::ConstantInt*, llvm::BasicBlock*> > &cases,
+        vector<SwitchCluster> &clusters) {
+    unsigned i = 0;
+    while (i < cases.size()) {
+        // longest run starting at i that is still at least half full
+        unsigned best = i;
+        for (unsigned j = i + 1; j < cases.size(); j++) {
+            int64_t range = cases[j].first->getSExtValue() -
+                            cases[i].first->getSExtValue() + 1;
+            if ((int64_t) (j - i + 1) * 2 >= range)
+                best = j;
+        }
+        if (best - i + 1 < MinJumpTableCases)
+            best = i;
+        SwitchCluster c;
+        c.lo = cases[i].first->getSExtValue();
+        c.hi = cases[best].first->getSExtValue();
+        c.cases.assign(cases.begin() + i, cases.begin() + best + 1);
+        clusters.push_back(c);
+        i = best + 1;
+    }
+}
+
+static llvm::BasicBlock *NewSwitchBlock(const char *name) {
+    llvm::BasicBlock *bb = llvm::BasicBlock::Create(
+        *Node::irgen->GetContext(), name, Node::irgen->GetFunction());
+    return bb;
+}
+
+// dispatch cond over clusters[l, r) from block bb, misses go to def
+static void EmitSwitchTree(llvm::Value *cond, vector<SwitchCluster> &clusters,
+                           unsigned l, unsigned r, llvm::BasicBlock *bb,
+                           llvm::BasicBlock *def) {
+    llvm::Type *ty = cond->getType();
+    if (r - l == 1) {
+        SwitchCluster &c = clusters[l];
+        if (c.cases.size() == 1) {
+            llvm::Value *eq = new llvm::ICmpInst(*bb, llvm::CmpInst::ICMP_EQ,
+                                                 cond, c.cases[0].first);
+            llvm::BranchInst::Create(c.cases[0].second, def, eq, bb);
+            return;
+        }
+        // (unsigned)(cond - lo) <= hi - lo, then the table itself
+        llvm::Value *off = llvm::BinaryOperator::CreateSub(cond,
+            llvm::ConstantInt::get(ty, c.lo), "", bb);
+        llvm::Value *in = new llvm::ICmpInst(*bb, llvm::CmpInst::ICMP_ULE, off,
+            llvm::ConstantInt::get(ty, c.hi - c.lo));
+        llvm::BasicBlock *table = NewSwitchBlock("switch table");
+        llvm::BranchInst::Create(table, def, in, bb);
+        llvm::SwitchInst *sw = llvm::SwitchInst::Create(cond, def,
+            c.cases.size(), table);
+        for (unsigned i = 0; i < c.cases.size(); i++)
+            sw->addCase(c.cases[i].first, c.cases[i].second);
+        return;
+    }
+    unsigned mid = (l + r) / 2;
+    llvm::BasicBlock *lb = NewSwitchBlock("switch lo");
+    llvm::BasicBlock *hb = NewSwitchBlock("switch hi");
+    llvm::Value *lt = new llvm::ICmpInst(*bb, llvm::CmpInst::ICMP_SLT, cond,
+        llvm::ConstantInt::get(ty, clusters[mid].lo));
+    llvm::BranchInst::Create(lb, hb, lt, bb);
+    EmitSwitchTree(cond, clusters, l, mid, lb, def);
+    EmitSwitchTree(cond, clusters, mid, r, hb, def);
+}
+
 llvm::Value* SwitchStmt::Emit() {
-    if (DEBUG)
-        cout << "SwitchStmt" << endl;
-    llvm::SwitchInst *psi = Node::switchI;
+    TRACE(TraceEmit, "SwitchStmt");
     llvm::BasicBlock *pbb = Node::breakB;
     llvm::LLVMContext *context = Node::irgen->GetContext();
     llvm::Function *f = Node::irgen->GetFunction();
+    llvm::Value *cond = expr->Emit();
     llvm::BasicBlock *head = Node::irgen->GetBasicBlock();
-    llvm::BasicBlock *defC = llvm::BasicBlock::Create(*context, "default", f);
-    llvm::BasicBlock *foot = llvm::BasicBlock::Create(*context, "Switch Foot", f);
-    Node::breakB = foot;
-    Node::switchI = llvm::SwitchInst::Create(expr->Emit(), defC, cases->NumElements(), head);
-    for (int i = 0;  i < cases->NumElements(); i++) {
-        if (Default *de = dynamic_cast<Default*>(cases->Nth(i))) {
-            def = de;
-            break;
+    llvm::BasicBlock *foot = llvm::BasicBlock::Create(*context, "switch footer");
+
+    // one detached block per run of labels (case 1: case 2: ... nest in
+    // the grammar), in source order, plus the statement the labels guard
+    int n = cases->NumElements();
+    vector<llvm::BasicBlock*> labelB(n, (llvm::BasicBlock*) NULL);
+    vector<Stmt*> bodyS(n, (Stmt*) NULL);
+    vector<pair<llvm::ConstantInt*, llvm::BasicBlock*> > table;
+    llvm::BasicBlock *defB = NULL;
+    for (int i = 0; i < n; i++) {
+        Stmt *st = cases->Nth(i);
+        while (SwitchLabel *l = dynamic_cast<SwitchLabel*>(st)) {
+            if (!labelB[i])
+                labelB[i] = llvm::BasicBlock::Create(*context,
+                    dynamic_cast<Default*>(l) ? "default" : "case");
+            if (dynamic_cast<Default*>(l)) {
+                defB = labelB[i];
+            } else {
+                // an IntConstant since Resolve()
+                table.push_back(make_pair(
+                    llvm::cast<llvm::ConstantInt>(l->getLabel()->Emit()),
+                    labelB[i]));
+            }
+            st = l->getStmt();
         }
-        cases->Nth(i)->Emit();
+        bodyS[i] = st;
     }
-    if (def) {
-        def->Emit();
-        if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-            llvm::BranchInst::Create(foot, Node::irgen->GetBasicBlock());
-        }
-        foot->moveAfter(Node::irgen->GetBasicBlock());
+    // distinct since Resolve()
+    std::sort(table.begin(), table.end(), CaseLess);
+
+    llvm::BasicBlock *miss = defB ? defB : foot;
+    if (table.empty()) {
+        llvm::BranchInst::Create(miss, head);
+    } else {
+        vector<SwitchCluster> clusters;
+        BuildClusters(table, clusters);
+        EmitSwitchTree(cond, clusters, 0, clusters.size(), head, miss);
     }
-    else {
-        //cout << "NO DEF" << endl;
-        defC->moveAfter(Node::irgen->GetBasicBlock());
-        llvm::BranchInst::Create(foot, defC);
-        if (!Node::irgen->GetBasicBlock()->getTerminator()) {
-            llvm::BranchInst::Create(defC, Node::irgen->GetBasicBlock());
+
+    // bodies in source order; a label block is entered by dispatch and by
+    // fallthrough, statements after a break are never emitted
+    Node::breakB = foot;
+    for (int i = 0; i < n; i++) {
+        llvm::BasicBlock *cur = Node::irgen->GetBasicBlock();
+        if (labelB[i]) {
+            if (!cur->getTerminator())
+                llvm::BranchInst::Create(labelB[i], cur);
+            labelB[i]->insertInto(f);
+            Node::irgen->SetBasicBlock(labelB[i]);
+        } else if (cur->getTerminator()) {
+            continue;
         }
-        foot->moveAfter(defC);
+        bodyS[i]->Emit();
     }
-    Node::irgen->SetBasicBlock(foot);
+    if (!Node::irgen->GetBasicBlock()->getTerminator())
+        llvm::BranchInst::Create(foot, Node::irgen->GetBasicBlock());
     Node::breakB = pbb;
-    Node::switchI = psi;
+    if (foot->use_empty()) {
+        // every path returned; the terminated block stops further emission
+        delete foot;
+        return NULL;
+    }
+    foot->insertInto(f);
+    Node::irgen->SetBasicBlock(foot);
     return NULL;
 }
+
 llvm::Value* BreakStmt::Emit() {
-    if (DEBUG)
-        cout << "BreakStmt" << endl;
+    TRACE(TraceEmit, "BreakStmt");
     llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
     llvm::BasicBlock *suc = Node::breakB;
     llvm::BranchInst::Create(suc, bb);
@@ -369,8 +1113,7 @@ llvm::Value* BreakStmt::Emit() {
 }
 
 llvm::Value* ContinueStmt::Emit() {
-    if (DEBUG)
-        cout << "ContinueStmt" << endl;
+    TRACE(TraceEmit, "ContinueStmt");
     llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
     llvm::BasicBlock *suc = Node::continueB;
     llvm::BranchInst::Create(suc, bb);
@@ -378,8 +1121,7 @@ llvm::Value* ContinueStmt::Emit() {
 }
 
 llvm::Value* ReturnStmt::Emit() {
-    if (DEBUG)
-        cout << "ReturnStmt" << endl;
+    TRACE(TraceEmit, "ReturnStmt");
     llvm::LLVMContext* context = Node::irgen->GetContext();
     llvm::BasicBlock *bb = Node::irgen->GetBasicBlock();
     if (expr) {
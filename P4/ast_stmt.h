@@ -18,6 +18,7 @@
 
 class Decl;
 class VarDecl;
+class FnDecl;
 class Expr;
 class IntConstant;
   
@@ -33,14 +34,16 @@ class Program : public Node
      const char *GetPrintNameForNode() { return "Program"; }
      void PrintChildren(int indentLevel);
      llvm::Value* Emit();
+     void EmitParallel(int threads, std::vector<FnDecl*> &bodies);
+     void Resolve();
 };
 
 class Stmt : public Node
 {
   public:
      Stmt() : Node() {}
-     Stmt(yyltype loc) : Node(loc) {}
-     llvm::Value* Emit() { if (DEBUG) { cout <<"Stmt" <<endl; } return NULL; }
+     Stmt(SourceRange loc) : Node(loc) {}
+     llvm::Value* Emit() { TRACE(TraceEmit, "Stmt"); return NULL; }
 };
 
 class StmtBlock : public Stmt 
@@ -51,7 +54,10 @@ class StmtBlock : public Stmt
     
   public:
     StmtBlock(List<VarDecl*> *variableDeclarations, List<Stmt*> *statements);
+    List<VarDecl*> *getDecls() { return decls; }
+    List<Stmt*> *getStmts() { return stmts; }
     llvm::Value* Emit();
+    void Resolve();
     const char *GetPrintNameForNode() { return "StmtBlock"; }
     void PrintChildren(int indentLevel);
 };
@@ -63,7 +69,9 @@ class DeclStmt: public Stmt
     
   public:
     DeclStmt(Decl *d);
+    Decl *getDecl() { return decl; }
     llvm::Value* Emit();
+    void Resolve();
     const char *GetPrintNameForNode() { return "DeclStmt"; }
     void PrintChildren(int indentLevel);
 };
@@ -77,13 +85,29 @@ class ConditionalStmt : public Stmt
   public:
     ConditionalStmt() : Stmt(), test(NULL), body(NULL) {}
     ConditionalStmt(Expr *testExpr, Stmt *body);
+    Expr *getTest() { return test; }
+    Stmt *getBody() { return body; }
 };
 
 class LoopStmt : public ConditionalStmt 
 {
+  protected:
+    // unroll(N) count, or FullUnroll / NoUnroll; 0 leaves it to LLVM
+    int unrollCount;
+    bool vectorize;
+
+    void EmitRotated(Expr *step, const char *kind);
+    void AttachLoopMetadata(llvm::BranchInst *latch);
+
   public:
+    static const int FullUnroll = -1;
+    static const int NoUnroll = -2;
+
     LoopStmt(Expr *testExpr, Stmt *body)
-            : ConditionalStmt(testExpr, body) {}
+            : ConditionalStmt(testExpr, body), unrollCount(0),
+              vectorize(false) {}
+    void AddPragma(const char *text);
+    int getUnrollCount() { return unrollCount; }
 };
 
 class ForStmt : public LoopStmt 
@@ -94,6 +118,10 @@ class ForStmt : public LoopStmt
   public:
     ForStmt(Expr *init, Expr *test, Expr *step, Stmt *body);
     llvm::Value* Emit();
+    bool EmitUnrolled();
+    void Resolve();
+    Expr *getInit() { return init; }
+    Expr *getStep() { return step; }
     const char *GetPrintNameForNode() { return "ForStmt"; }
     void PrintChildren(int indentLevel);
 };
@@ -103,6 +131,7 @@ class WhileStmt : public LoopStmt
   public:
     WhileStmt(Expr *test, Stmt *body) : LoopStmt(test, body) {}
     llvm::Value* Emit();
+    void Resolve();
     const char *GetPrintNameForNode() { return "WhileStmt"; }
     void PrintChildren(int indentLevel);
 };
@@ -115,7 +144,10 @@ class IfStmt : public ConditionalStmt
   public:
     IfStmt() : ConditionalStmt(), elseBody(NULL) {}
     llvm::Value* Emit();
+    bool EmitSelect(llvm::Value *cond);
+    void Resolve();
     IfStmt(Expr *test, Stmt *thenBody, Stmt *elseBody);
+    Stmt *getElseBody() { return elseBody; }
     const char *GetPrintNameForNode() { return "IfStmt"; }
     void PrintChildren(int indentLevel);
 };
@@ -150,7 +182,9 @@ class ReturnStmt : public Stmt
   
   public:
     ReturnStmt(yyltype loc, Expr *expr = NULL);
+    Expr *getExpr() { return expr; }
     llvm::Value* Emit(); 
+    void Resolve();
     const char *GetPrintNameForNode() { return "ReturnStmt"; }
     void PrintChildren(int indentLevel);
 };
@@ -165,6 +199,9 @@ class SwitchLabel : public Stmt
     SwitchLabel() { label = NULL; stmt = NULL; }
     SwitchLabel(Expr *label, Stmt *stmt);
     SwitchLabel(Stmt *stmt);
+    Expr *getLabel() { return label; }
+    Stmt *getStmt() { return stmt; }
+    void Resolve();
     void PrintChildren(int indentLevel);
 };
 
@@ -196,6 +233,9 @@ class SwitchStmt : public Stmt
     SwitchStmt() : expr(NULL), cases(NULL), def(NULL) {}
     SwitchStmt(Expr *expr, List<Stmt*> *cases, Default *def);
     llvm::Value* Emit();
+    Expr *getExpr() { return expr; }
+    List<Stmt*> *getCases() { return cases; }
+    void Resolve();
     virtual const char *GetPrintNameForNode() { return "SwitchStmt"; }
     void PrintChildren(int indentLevel);
 };
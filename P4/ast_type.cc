@@ -61,7 +61,37 @@ llvm::Type* Type::convert() {
         return NULL;
 }
 	
-NamedType::NamedType(Identifier *i) : Type(*i->GetLocation()) {
+int Type::Size() {
+    if (this == vec2Type || this == mat2Type)
+        return 2;
+    if (this == vec3Type || this == mat3Type)
+        return 3;
+    if (this == vec4Type || this == mat4Type)
+        return 4;
+    return 1;
+}
+
+Type* Type::FloatVector(int n) {
+    switch (n) {
+        case 1: return floatType;
+        case 2: return vec2Type;
+        case 3: return vec3Type;
+        case 4: return vec4Type;
+        default: return errorType;
+    }
+}
+
+/* The implicit conversions IRGenerator::CreateConversion performs for
+ * initializers and by-value arguments: between int, float and bool, and
+ * from any of them to a vector by splatting.
+ */
+bool Type::IsConvertibleTo(Type *other) {
+    if (this == other)
+        return true;
+    return IsScalar() && (other->IsScalar() || other->IsVector());
+}
+
+NamedType::NamedType(Identifier *i) : Type(i->GetLocation()) {
     Assert(i != NULL);
     (id=i)->SetParent(this);
 } 
@@ -27,10 +27,23 @@ class Type : public Node
                 *mat2Type, *mat3Type, *mat4Type,
                 *errorType;
 
-    Type(yyltype loc) : Node(loc) {}
+    Type(SourceRange loc) : Node(loc) {}
     Type(const char *str);
     llvm::Type *convert();
     const char *getName() { return typeName; }
+
+    // built-in types are shared, so two types are equal iff the pointers are
+    bool IsScalar() { return this == intType || this == floatType ||
+                             this == boolType; }
+    bool IsVector() { return this == vec2Type || this == vec3Type ||
+                             this == vec4Type; }
+    bool IsMatrix() { return this == mat2Type || this == mat3Type ||
+                             this == mat4Type; }
+    bool IsNumeric() { return this == intType || this == floatType ||
+                              IsVector() || IsMatrix(); }
+    int Size();                         // N of vecN and matN, 1 otherwise
+    static Type *FloatVector(int n);    // float, vec2, vec3 or vec4
+    bool IsConvertibleTo(Type *other);
     const char *GetPrintNameForNode() { return "Type"; }
     void PrintChildren(int indentLevel);
 };
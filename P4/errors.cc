@@ -9,35 +9,130 @@
 #include <sstream>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <mutex>
+#include <algorithm>
 using namespace std;
+#include "utility.h"
 #include "scanner.h" // for GetLineNumbered
+#include "ast_type.h"
+#include "ast_expr.h"
+#include "ast_stmt.h"
 
 
-int ReportError::numErrors = 0;
+atomic<int> ReportError::numErrors(0);
+vector<ReportError::Diagnostic> ReportError::diagnostics;
 
-void ReportError::UnderlineErrorInLine(const char *line, yyltype *pos) {
+// -femit-threads workers report concurrently
+static mutex outputLock;
+
+void ReportError::UnderlineErrorInLine(const char *line, int first, int last,
+                                       string &out) {
     if (!line) return;
-    cerr << line << endl;
-    for (int i = 1; i <= pos->last_column; i++)
-        cerr << (i >= pos->first_column ? '^' : ' ');
-    cerr << endl;
+    out += line;
+    out += '\n';
+    for (int i = 1; i <= last; i++)
+        out += (i >= first ? '^' : ' ');
+    out += '\n';
 }
 
  
  
-void ReportError::OutputError(yyltype *loc, string msg) {
+// everything is kept: which errors survive the limit is decided in Flush
+void ReportError::OutputError(SourceRange loc, string msg) {
     numErrors++;
+    Diagnostic d;
+    d.line = loc.IsValid() ? LineOf(loc.begin) : 0;
+    d.firstColumn = loc.IsValid() ? ColumnOf(loc.begin) : 0;
+    d.lastColumn = loc.IsValid() ? ColumnOf(loc.end) : 0;
+    d.message = msg;
+    lock_guard<mutex> guard(outputLock);
+    diagnostics.push_back(d);
+}
+
+bool ReportError::LimitReached() {
+    int limit = GetIntOption("error-limit", 0);
+    return limit > 0 && numErrors >= limit;
+}
+
+static string JsonString(const string &s) {
+    string out = "\"";
+    for (unsigned i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n')
+            out += "\\n";
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            sprintf(buf, "\\u%04x", c);
+            out += buf;
+        } else
+            out += c;
+    }
+    return out + "\"";
+}
+
+void ReportError::Flush() {
+    lock_guard<mutex> guard(outputLock);
+    // workers report out of order, so sort fully before applying the
+    // limit; errors without a line go last
+    sort(diagnostics.begin(), diagnostics.end(),
+         [](const Diagnostic &a, const Diagnostic &b) {
+             int la = a.line ? a.line : INT_MAX;
+             int lb = b.line ? b.line : INT_MAX;
+             if (la != lb)
+                 return la < lb;
+             if (a.firstColumn != b.firstColumn)
+                 return a.firstColumn < b.firstColumn;
+             return a.message < b.message;
+         });
+    int limit = GetIntOption("error-limit", 0);
+    if (limit > 0 && (int) diagnostics.size() > limit)
+        diagnostics.resize(limit);
+    int dropped = numErrors - diagnostics.size();
+    const char *format = GetOption("diagnostics-format");
+    ostringstream out;
+    if (format && strcmp(format, "json") == 0) {
+        out << "{\"diagnostics\":[";
+        for (unsigned i = 0; i < diagnostics.size(); i++) {
+            Diagnostic &d = diagnostics[i];
+            out << (i ? "," : "") << "{\"severity\":\"error\"";
+            if (d.line)
+                out << ",\"line\":" << d.line << ",\"column\":"
+                    << d.firstColumn << ",\"endColumn\":" << d.lastColumn;
+            out << ",\"message\":" << JsonString(d.message) << "}";
+        }
+        out << "],\"errors\":" << numErrors << ",\"truncated\":"
+            << (dropped > 0 ? "true" : "false") << "}\n";
+    } else {
+        string text;
+        for (unsigned i = 0; i < diagnostics.size(); i++) {
+            Diagnostic &d = diagnostics[i];
+            if (d.line) {
+                out << "\n*** Error line " << d.line << ".\n";
+                text.clear();
+                UnderlineErrorInLine(GetLineNumbered(d.line), d.firstColumn,
+                                     d.lastColumn, text);
+                out << text;
+            } else
+                out << "\n*** Error.\n";
+            out << "*** " << d.message << "\n\n";
+        }
+        if (dropped > 0)
+            out << "*** Error limit reached, " << dropped
+                << " more errors not shown.\n";
+    }
+    string s = out.str();
     fflush(stdout); // make sure any buffered text has been output
-    if (loc) {
-        cerr << endl << "*** Error line " << loc->first_line << "." << endl;
-        UnderlineErrorInLine(GetLineNumbered(loc->first_line), loc);
-    } else
-        cerr << endl << "*** Error." << endl;
-    cerr << "*** " << msg << endl << endl;
+    fwrite(s.data(), 1, s.size(), stderr);
+    diagnostics.clear();
 }
 
 
-void ReportError::Formatted(yyltype *loc, const char *format, ...) {
+void ReportError::Formatted(SourceRange loc, const char *format, ...) {
     va_list args;
     char errbuf[2048];
     
@@ -48,27 +143,79 @@ void ReportError::Formatted(yyltype *loc, const char *format, ...) {
 }
 
 void ReportError::UntermComment() {
-    OutputError(NULL, "Input ends with unterminated comment");
+    OutputError(SourceRange(), "Input ends with unterminated comment");
 }
 
 
-void ReportError::LongIdentifier(yyltype *loc, const char *ident) {
+void ReportError::LongIdentifier(SourceRange loc, const char *ident) {
     ostringstream s;
     s << "Identifier too long: \"" << ident << "\"";
     OutputError(loc, s.str());
 }
 
-void ReportError::UntermString(yyltype *loc, const char *str) {
+void ReportError::UntermString(SourceRange loc, const char *str) {
     ostringstream s;
     s << "Unterminated string constant: " << str;
     OutputError(loc, s.str());
 }
 
-void ReportError::UnrecogChar(yyltype *loc, char ch) {
+void ReportError::UnrecogChar(SourceRange loc, char ch) {
     ostringstream s;
     s << "Unrecognized char: '" << ch << "'";
     OutputError(loc, s.str());
 }
+
+void ReportError::IncompatibleOperands(Operator *op, Type *lhs, Type *rhs) {
+    ostringstream s;
+    s << "Incompatible operands: " << lhs->getName() << " " << op->getOp()
+      << " " << rhs->getName();
+    OutputError(op->GetLocation(), s.str());
+}
+
+void ReportError::IncompatibleOperand(Operator *op, Type *rhs) {
+    ostringstream s;
+    s << "Incompatible operand: " << op->getOp() << " " << rhs->getName();
+    OutputError(op->GetLocation(), s.str());
+}
+
+void ReportError::InaccessibleSwizzle(Identifier *field, Type *base) {
+    ostringstream s;
+    s << base->getName() << " non-vector type can't have swizzle '"
+      << field->getName() << "'";
+    OutputError(field->GetLocation(), s.str());
+}
+
+void ReportError::InvalidSwizzle(Identifier *field) {
+    ostringstream s;
+    s << "swizzle '" << field->getName()
+      << "' is not proper subset of [xyzw], [rgba] or [stpq]";
+    OutputError(field->GetLocation(), s.str());
+}
+
+void ReportError::SwizzleOutOfBound(Identifier *field, Type *base) {
+    ostringstream s;
+    s << base->getName() << " swizzle '" << field->getName()
+      << "' exceeds its vector component";
+    OutputError(field->GetLocation(), s.str());
+}
+
+void ReportError::OversizedVector(Identifier *field) {
+    ostringstream s;
+    s << "swizzle '" << field->getName()
+      << "' generates a vector longer than vec4";
+    OutputError(field->GetLocation(), s.str());
+}
+
+void ReportError::TestNotBoolean(Expr *expr) {
+    OutputError(expr->GetLocation(), "Test expression must have boolean type");
+}
+
+void ReportError::ReturnMismatch(ReturnStmt *rStmt, Type *given, Type *expected) {
+    ostringstream s;
+    s << "Incompatible return: " << given->getName() << " given, "
+      << expected->getName() << " expected";
+    OutputError(rStmt->GetLocation(), s.str());
+}
   
 /**
  * Function: yyerror()
@@ -82,5 +229,5 @@ void ReportError::UnrecogChar(yyltype *loc, char ch) {
  */
 
 void yyerror(const char *msg) {
-    ReportError::Formatted(&yylloc, "%s", msg);
+    ReportError::Formatted(yylloc, "%s", msg);
 }
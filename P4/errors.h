@@ -13,7 +13,9 @@
 #ifndef _errors_h_
 #define _errors_h_
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include "location.h"
 using namespace std;
 
@@ -31,34 +33,69 @@ using namespace std;
  *       ReportError::UntermString(&yylloc, str);
  *    }
  *
- * For some methods, the first argument is the pointer to the location
- * structure that identifies where the problem is (usually this is the
- * location of the offending token). You can pass NULL for the argument
- * if there is no appropriate position to point out. For other methods,
+ * For some methods, the first argument is the location that identifies
+ * where the problem is (usually this is the location of the offending
+ * token). You can pass SourceRange() if there is no appropriate position
+ * to point out. For other methods,
  * location is accessed by messaging the node in error which is passed
  * as an argument. You cannot pass NULL for these arguments.
+ *
+ * Errors are collected rather than printed, and Flush() writes them all
+ * at once, ordered by position: as text, or as a single JSON object with
+ * --diagnostics-format=json. With -ferror-limit=N only the first N in
+ * that order are shown, and LimitReached() tells the running phase to
+ * give up once N have been reported.
  */
 
+class Type;
+class Identifier;
+class Expr;
+class ReturnStmt;
+class Operator;
 
 class ReportError {
  public:
 
   // Errors used by scanner
   static void UntermComment(); 
-  static void LongIdentifier(yyltype *loc, const char *ident);
-  static void UntermString(yyltype *loc, const char *str);
-  static void UnrecogChar(yyltype *loc, char ch);
+  static void LongIdentifier(SourceRange loc, const char *ident);
+  static void UntermString(SourceRange loc, const char *str);
+  static void UnrecogChar(SourceRange loc, char ch);
+
+  // Errors used by semantic analyzer for expressions
+  static void IncompatibleOperand(Operator *op, Type *rhs); // unary
+  static void IncompatibleOperands(Operator *op, Type *lhs, Type *rhs); // binary
+
+  // Errors used by semantic analyzer for vector access
+  static void InaccessibleSwizzle(Identifier *swizzle, Type *base);
+  static void InvalidSwizzle(Identifier *swizzle);
+  static void SwizzleOutOfBound(Identifier *swizzle, Type *base);
+  static void OversizedVector(Identifier *swizzle);
+
+  // Errors used by semantic analyzer for control structures
+  static void TestNotBoolean(Expr *testExpr);
+  static void ReturnMismatch(ReturnStmt *rStmt, Type *given, Type *expected);
 
   // Generic method to report a printf-style error message
-  static void Formatted(yyltype *loc, const char *format, ...);
+  static void Formatted(SourceRange loc, const char *format, ...);
 
 
-  // Returns number of error messages printed
+  // Returns number of errors reported, including any beyond the limit
   static int NumErrors() { return numErrors; }
+  static bool LimitReached();
+  static void Flush();
   
  private:
-  static void UnderlineErrorInLine(const char *line, yyltype *pos);
-  static void OutputError(yyltype *loc, string msg);
-  static int numErrors;
+  struct Diagnostic {
+    int line;                   // 0 if the error has no location
+    int firstColumn, lastColumn;
+    string message;
+  };
+
+  static void UnderlineErrorInLine(const char *line, int first, int last,
+                                   string &out);
+  static void OutputError(SourceRange loc, string msg);
+  static atomic<int> numErrors;
+  static vector<Diagnostic> diagnostics;
 };
 #endif
@@ -4,6 +4,18 @@
  */
 
 #include "irgen.h"
+#include "utility.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <set>
+#include <string.h>
 
 IRGenerator::IRGenerator() : 
     context(NULL),
@@ -14,6 +26,8 @@ IRGenerator::IRGenerator() :
 }
 
 IRGenerator::~IRGenerator() {
+    delete module;
+    delete context;
 }
 
 llvm::Module *IRGenerator::GetOrCreateModule(const char *moduleID)
@@ -102,6 +116,979 @@ llvm::Type *IRGenerator::GetMat4Type() const {
     return ty;
 }
 
+/* Splats are an insertelement into lane 0 followed by a shufflevector with
+ * an all-zero mask, which the backends match to a single broadcast.
+ * Constant scalars fold straight into a constant splat vector.
+ */
+llvm::Value *IRGenerator::CreateSplat(llvm::Value *scalar,
+                                      unsigned numElements) {
+    if (llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(scalar))
+        return llvm::ConstantVector::getSplat(numElements, c);
+    llvm::Type *vecTy = llvm::VectorType::get(scalar->getType(), numElements);
+    llvm::Value *zero = llvm::ConstantInt::get(GetIntType(), 0);
+    llvm::Value *ins = llvm::InsertElementInst::Create(
+        llvm::UndefValue::get(vecTy), scalar, zero, "", currentBB);
+    llvm::Constant *mask = llvm::ConstantAggregateZero::get(
+        llvm::VectorType::get(GetIntType(), numElements));
+    return new llvm::ShuffleVectorInst(ins, llvm::UndefValue::get(vecTy),
+                                       mask, "", currentBB);
+}
+
+/* Locals live in the entry block so mem2reg can promote them no matter
+ * how deeply nested the code that introduced them was.
+ */
+llvm::AllocaInst *IRGenerator::CreateEntryAlloca(llvm::Type *ty,
+                                                 const char *name) {
+    llvm::BasicBlock &entry = currentFunc->getEntryBlock();
+    if (entry.empty())
+        return new llvm::AllocaInst(ty, name, &entry);
+    return new llvm::AllocaInst(ty, name, &*entry.begin());
+}
+
+/* Converts between int, bool and float, lane by lane for vectors of the
+ * same width; a scalar converted to a vector type is splatted. Constant
+ * operands fold to constants.
+ */
+llvm::Value *IRGenerator::CreateConversion(llvm::Value *val, llvm::Type *ty) {
+    llvm::Type *from = val->getType();
+    if (from == ty)
+        return val;
+    if (ty->isVectorTy() && !from->isVectorTy())
+        return CreateSplat(CreateConversion(val, ty->getVectorElementType()),
+                           ty->getVectorNumElements());
+    llvm::Type *fromElt = from->getScalarType();
+    llvm::Type *toElt = ty->getScalarType();
+    llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(val);
+
+    if (toElt == GetBoolType()) {
+        llvm::Constant *zero = llvm::Constant::getNullValue(from);
+        if (fromElt->isFloatTy()) {
+            if (c)
+                return llvm::ConstantExpr::getFCmp(llvm::CmpInst::FCMP_UNE,
+                                                   c, zero);
+            return new llvm::FCmpInst(*currentBB, llvm::CmpInst::FCMP_UNE,
+                                      val, zero);
+        }
+        if (fromElt->isIntegerTy()) {
+            if (c)
+                return llvm::ConstantExpr::getICmp(llvm::CmpInst::ICMP_NE,
+                                                   c, zero);
+            return new llvm::ICmpInst(*currentBB, llvm::CmpInst::ICMP_NE,
+                                      val, zero);
+        }
+        return val;
+    }
+
+    llvm::Instruction::CastOps op;
+    if (toElt->isFloatTy() && fromElt == GetBoolType())
+        op = llvm::Instruction::UIToFP;
+    else if (toElt->isFloatTy() && fromElt->isIntegerTy())
+        op = llvm::Instruction::SIToFP;
+    else if (toElt->isIntegerTy() && fromElt->isFloatTy())
+        op = llvm::Instruction::FPToSI;
+    else if (toElt->isIntegerTy() && fromElt == GetBoolType())
+        op = llvm::Instruction::ZExt;
+    else
+        return val;
+    if (c)
+        return llvm::ConstantExpr::getCast(op, c, ty);
+    return llvm::CastInst::Create(op, val, ty, "", currentBB);
+}
+
+/* Blocks left open by the emitter (a footer after an if whose branches
+ * both return, say) return from the function; once everything is
+ * terminated the blocks nothing reaches are deleted and a block whose
+ * only predecessor branches straight to it is folded into it.
+ */
+void IRGenerator::FinishFunction() {
+    llvm::Function *f = currentFunc;
+    llvm::Type *retTy = f->getReturnType();
+    for (llvm::Function::iterator it = f->begin(); it != f->end(); ++it) {
+        if (it->getTerminator())
+            continue;
+        if (retTy->isVoidTy())
+            llvm::ReturnInst::Create(*context, &*it);
+        else
+            llvm::ReturnInst::Create(*context, llvm::UndefValue::get(retTy),
+                                     &*it);
+    }
+    llvm::removeUnreachableBlocks(*f);
+    for (llvm::Function::iterator it = f->begin(); it != f->end(); ) {
+        llvm::BasicBlock *bb = &*it++;
+        llvm::MergeBlockIntoPredecessor(bb);
+    }
+    ApplyFastMath();
+}
+
+// arithmetic, compares and math calls; FP loads and phis carry no flags
+static bool IsFPMath(llvm::Instruction *inst) {
+    return llvm::isa<llvm::FPMathOperator>(inst) &&
+        (llvm::isa<llvm::BinaryOperator>(inst) ||
+         llvm::isa<llvm::FCmpInst>(inst) || llvm::isa<llvm::CallInst>(inst));
+}
+
+bool IRGenerator::AllowContraction() const {
+    if (!preciseMarks.empty())
+        return false;
+    const char *contract = GetOption("fp-contract");
+    if (contract)
+        return strcmp(contract, "on") == 0 || strcmp(contract, "fast") == 0;
+    return IsOptionOn("fast-math");
+}
+
+void IRGenerator::BeginPrecise() {
+    llvm::Instruction *last = NULL;
+    if (currentBB && !currentBB->empty())
+        last = &currentBB->back();
+    preciseMarks.push_back(std::make_pair(currentBB, last));
+}
+
+/* Tags every FP operation emitted since the matching BeginPrecise with
+ * glsl.precise metadata, so ApplyFastMath leaves it strict. Blocks opened
+ * inside the region follow the first one in layout order.
+ */
+void IRGenerator::EndPrecise() {
+    std::pair<llvm::BasicBlock *, llvm::Instruction *> mark =
+        preciseMarks.back();
+    preciseMarks.pop_back();
+    if (!mark.first)
+        return;
+    llvm::MDNode *tag = llvm::MDNode::get(*context,
+        llvm::MDString::get(*context, "glsl.precise"));
+    llvm::Function::iterator bb = mark.first->getIterator();
+    llvm::BasicBlock::iterator it = mark.second
+        ? ++mark.second->getIterator() : bb->begin();
+    for (;;) {
+        for (; it != bb->end(); ++it) {
+            if (IsFPMath(&*it))
+                it->setMetadata("glsl.precise", tag);
+        }
+        if (&*bb == currentBB || ++bb == bb->getParent()->end())
+            break;
+        it = bb->begin();
+    }
+}
+
+llvm::Value *IRGenerator::CreateIntOp(llvm::Instruction::BinaryOps op,
+                                      llvm::Value *lhs, llvm::Value *rhs) {
+    llvm::BinaryOperator *inst =
+        llvm::BinaryOperator::Create(op, lhs, rhs, "", currentBB);
+    if (IsOptionOn("strict-overflow") &&
+        (op == llvm::Instruction::Add || op == llvm::Instruction::Sub ||
+         op == llvm::Instruction::Mul))
+        inst->setHasNoSignedWrap(true);
+    return inst;
+}
+
+/* LLVM 3.x only has nnan, ninf, nsz, arcp and the catch-all unsafe-algebra
+ * bit; reassoc and afn both map onto the latter.
+ */
+void IRGenerator::ApplyFastMath() {
+    bool fast = IsOptionOn("fast-math");
+    llvm::FastMathFlags fmf;
+    if (fast || IsOptionOn("reassoc") || IsOptionOn("afn"))
+        fmf.setUnsafeAlgebra();
+    if (fast || IsOptionOn("nnan"))
+        fmf.setNoNaNs();
+    if (fast || IsOptionOn("ninf"))
+        fmf.setNoInfs();
+    if (fast || IsOptionOn("nsz"))
+        fmf.setNoSignedZeros();
+    if (fast || IsOptionOn("arcp"))
+        fmf.setAllowReciprocal();
+    if (!fmf.any())
+        return;
+    for (llvm::inst_iterator it = llvm::inst_begin(currentFunc),
+         end = llvm::inst_end(currentFunc); it != end; ++it) {
+        if (!IsFPMath(&*it) || it->getMetadata("glsl.precise"))
+            continue;
+        it->setFastMathFlags(fmf);
+    }
+}
+
+/* Leaf functions (nothing but intrinsics called) whose bodies are at most
+ * InlineThreshold instructions are always inlined into their callers.
+ */
+bool IRGenerator::IsInlineCandidate(llvm::Function *callee) const {
+    if (callee->isDeclaration() || callee == currentFunc)
+        return false;
+    unsigned size = 0;
+    for (llvm::inst_iterator it = llvm::inst_begin(callee),
+         end = llvm::inst_end(callee); it != end; ++it) {
+        if (llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&*it)) {
+            llvm::Function *fn = call->getCalledFunction();
+            if (!fn || !fn->isIntrinsic())
+                return false;
+        }
+        if (++size > InlineThreshold)
+            return false;
+    }
+    return true;
+}
+
+void IRGenerator::AddCall(llvm::CallInst *call) {
+    if (IsInlineCandidate(call->getCalledFunction()))
+        pendingInlines.push_back(call);
+}
+
+/* Run after the caller is fully emitted, so the block splits done by the
+ * inliner never disturb the block the emitter is appending to. Calls in
+ * unreachable code were deleted with their block and are skipped.
+ */
+void IRGenerator::InlineCalls() {
+    for (unsigned i = 0; i < pendingInlines.size(); i++) {
+        llvm::Value *call = pendingInlines[i];
+        if (!call)
+            continue;
+        llvm::InlineFunctionInfo info;
+        llvm::InlineFunction(llvm::cast<llvm::CallInst>(call), info);
+    }
+    pendingInlines.clear();
+}
+
+std::string IRGenerator::WriteBitcode() {
+    std::string bitcode;
+    llvm::raw_string_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(module, os);
+    os.flush();
+    return bitcode;
+}
+
+void IRGenerator::LinkBitcode(const std::string &bitcode) {
+    llvm::MemoryBufferRef buf(bitcode, "worker");
+    llvm::ErrorOr<std::unique_ptr<llvm::Module> > src =
+        llvm::parseBitcodeFile(buf, *context);
+    if (!src)
+        Failure("Cannot read back worker module: %s",
+                src.getError().message().c_str());
+    if (llvm::Linker::linkModules(*module, std::move(src.get())))
+        Failure("Cannot link worker module");
+}
+
+/* A callee qualifies once it is done itself, i.e. comes earlier in the
+ * source, which is what sequential emission would have seen.
+ */
+void IRGenerator::InlineLinkedCalls(const std::vector<llvm::Function *> &fns) {
+    std::set<llvm::Function *> done;
+    for (unsigned i = 0; i < fns.size(); i++) {
+        currentFunc = fns[i];
+        for (llvm::inst_iterator it = llvm::inst_begin(currentFunc),
+             end = llvm::inst_end(currentFunc); it != end; ++it) {
+            llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(&*it);
+            llvm::Function *callee = call ? call->getCalledFunction() : NULL;
+            if (callee && done.count(callee) && IsInlineCandidate(callee))
+                pendingInlines.push_back(call);
+        }
+        InlineCalls();
+        done.insert(currentFunc);
+    }
+    currentFunc = NULL;
+}
+
+llvm::Type *IRGenerator::GetMatType(unsigned size) const {
+    if (size == 2)
+        return GetMat2Type();
+    else if (size == 3)
+        return GetMat3Type();
+    return GetMat4Type();
+}
+
+/* Broadcasts one lane of a vector across all of its lanes with a single
+ * shufflevector, so nothing is moved out into a scalar register.
+ */
+llvm::Value *IRGenerator::CreateLaneSplat(llvm::Value *vec, unsigned lane) {
+    unsigned n = vec->getType()->getVectorNumElements();
+    if (llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(vec))
+        return llvm::ConstantVector::getSplat(n, c->getAggregateElement(lane));
+    llvm::Constant *mask = llvm::ConstantVector::getSplat(n,
+        llvm::ConstantInt::get(GetIntType(), lane));
+    return new llvm::ShuffleVectorInst(vec,
+        llvm::UndefValue::get(vec->getType()), mask, "", currentBB);
+}
+
+/* a * b + c through llvm.fmuladd, which the backend turns into an FMA
+ * wherever the target has one and into a mul/add pair otherwise. When
+ * contraction is off, or inside precise, it is a separate fmul and fadd,
+ * so mat*vec, mix and smoothstep round like the source expression.
+ */
+llvm::Value *IRGenerator::CreateFMulAdd(llvm::Value *a, llvm::Value *b,
+                                        llvm::Value *c) {
+    if (!AllowContraction()) {
+        llvm::Value *mul = llvm::BinaryOperator::CreateFMul(a, b, "",
+                                                            currentBB);
+        return llvm::BinaryOperator::CreateFAdd(mul, c, "", currentBB);
+    }
+    llvm::Function *fn = llvm::Intrinsic::getDeclaration(module,
+        llvm::Intrinsic::fmuladd, a->getType());
+    llvm::Value *args[] = { a, b, c };
+    return llvm::CallInst::Create(fn, args, "", currentBB);
+}
+
+/* Assembles a vector from components, each a scalar (lane -1) or one lane
+ * of a source vector. All-constant components give a ConstantVector.
+ * Otherwise each run of lanes taken from one source vector costs a single
+ * shuffle, plus a blend shuffle once a second source is involved; the
+ * first two same-typed sources share one two-input shuffle.
+ */
+llvm::Value *IRGenerator::BuildVector(llvm::Type *ty,
+                                      std::vector<Component> &comps) {
+    unsigned n = ty->getVectorNumElements();
+    llvm::Type *elt = ty->getVectorElementType();
+    llvm::Type *intTy = GetIntType();
+    llvm::BasicBlock *bb = currentBB;
+
+    std::vector<llvm::Constant *> consts;
+    for (unsigned i = 0; i < n && i < comps.size(); i++) {
+        llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(comps[i].first);
+        if (!c)
+            break;
+        if (comps[i].second >= 0)
+            c = c->getAggregateElement(comps[i].second);
+        consts.push_back(llvm::cast<llvm::Constant>(CreateConversion(c, elt)));
+    }
+    if (consts.size() == n)
+        return llvm::ConstantVector::get(consts);
+
+    llvm::Value *result = llvm::UndefValue::get(ty);
+    // the only source so far, and the lanes it was shuffled into
+    llvm::Value *sole = NULL;
+    std::vector<int> soleMask;
+    bool empty = true;
+
+    unsigned pos = 0;
+    while (pos < n && pos < comps.size()) {
+        llvm::Value *src = comps[pos].first;
+        if (comps[pos].second < 0) {
+            llvm::Value *idx = llvm::ConstantInt::get(intTy, pos);
+            result = llvm::InsertElementInst::Create(result,
+                CreateConversion(src, elt), idx, "", bb);
+            sole = NULL;
+            empty = false;
+            pos++;
+            continue;
+        }
+        src = CreateConversion(src, llvm::VectorType::get(elt,
+            src->getType()->getVectorNumElements()));
+        unsigned k = src->getType()->getVectorNumElements();
+        std::vector<int> mask(n, -1);
+        unsigned end = pos;
+        while (end < n && end < comps.size() &&
+               comps[end].first == comps[pos].first && comps[end].second >= 0) {
+            mask[end] = comps[end].second;
+            end++;
+        }
+
+        if (sole && sole->getType() == src->getType()) {
+            std::vector<llvm::Constant *> both;
+            for (unsigned i = 0; i < n; i++) {
+                if (mask[i] >= 0)
+                    both.push_back(llvm::ConstantInt::get(intTy, k + mask[i]));
+                else if (soleMask[i] >= 0)
+                    both.push_back(llvm::ConstantInt::get(intTy, soleMask[i]));
+                else
+                    both.push_back(llvm::UndefValue::get(intTy));
+            }
+            result = new llvm::ShuffleVectorInst(sole, src,
+                llvm::ConstantVector::get(both), "", bb);
+            sole = NULL;
+            pos = end;
+            continue;
+        }
+
+        llvm::Value *placed = src;
+        bool identity = (k == n);
+        for (unsigned i = 0; identity && i < n; i++)
+            identity = (mask[i] == (int) i);
+        if (!identity) {
+            std::vector<llvm::Constant *> lanes;
+            for (unsigned i = 0; i < n; i++) {
+                if (mask[i] >= 0)
+                    lanes.push_back(llvm::ConstantInt::get(intTy, mask[i]));
+                else
+                    lanes.push_back(llvm::UndefValue::get(intTy));
+            }
+            placed = new llvm::ShuffleVectorInst(src,
+                llvm::UndefValue::get(src->getType()),
+                llvm::ConstantVector::get(lanes), "", bb);
+        }
+        if (empty) {
+            result = placed;
+            sole = src;
+            soleMask = mask;
+        } else {
+            std::vector<llvm::Constant *> blend;
+            for (unsigned i = 0; i < n; i++)
+                blend.push_back(llvm::ConstantInt::get(intTy,
+                    mask[i] >= 0 ? n + i : i));
+            result = new llvm::ShuffleVectorInst(result, placed,
+                llvm::ConstantVector::get(blend), "", bb);
+            sole = NULL;
+        }
+        empty = false;
+        pos = end;
+    }
+    return result;
+}
+
+/* The mask is bitcast to an N-bit integer and compared once, which the
+ * backend turns into a single movmsk/ptest style test.
+ */
+llvm::Value *IRGenerator::CreateAllOf(llvm::Value *mask) {
+    unsigned n = mask->getType()->getVectorNumElements();
+    llvm::Type *bitsTy = llvm::IntegerType::get(*context, n);
+    llvm::Value *bits = new llvm::BitCastInst(mask, bitsTy, "", currentBB);
+    return new llvm::ICmpInst(*currentBB, llvm::CmpInst::ICMP_EQ, bits,
+                              llvm::Constant::getAllOnesValue(bitsTy));
+}
+
+llvm::Value *IRGenerator::CreateAnyOf(llvm::Value *mask) {
+    unsigned n = mask->getType()->getVectorNumElements();
+    llvm::Type *bitsTy = llvm::IntegerType::get(*context, n);
+    llvm::Value *bits = new llvm::BitCastInst(mask, bitsTy, "", currentBB);
+    return new llvm::ICmpInst(*currentBB, llvm::CmpInst::ICMP_NE, bits,
+                              llvm::Constant::getNullValue(bitsTy));
+}
+
+/* Matrices compare column by column; the column masks are combined with
+ * vector and/or so there is still only one reduction.
+ */
+llvm::Value *IRGenerator::CreateAggregateCompare(bool equal,
+                                                 llvm::Value *lhs,
+                                                 llvm::Value *rhs) {
+    llvm::CmpInst::Predicate pred =
+        equal ? llvm::CmpInst::FCMP_OEQ : llvm::CmpInst::FCMP_UNE;
+    llvm::Value *mask;
+    if (lhs->getType()->isArrayTy()) {
+        unsigned n = lhs->getType()->getArrayNumElements();
+        mask = NULL;
+        for (unsigned c = 0; c < n; c++) {
+            llvm::Value *col = new llvm::FCmpInst(*currentBB, pred,
+                GetColumn(lhs, c), GetColumn(rhs, c));
+            if (!mask)
+                mask = col;
+            else if (equal)
+                mask = llvm::BinaryOperator::CreateAnd(mask, col, "",
+                                                       currentBB);
+            else
+                mask = llvm::BinaryOperator::CreateOr(mask, col, "",
+                                                      currentBB);
+        }
+    } else {
+        mask = new llvm::FCmpInst(*currentBB, pred, lhs, rhs);
+    }
+    return equal ? CreateAllOf(mask) : CreateAnyOf(mask);
+}
+
+/* Reads the float lanes of a constant scalar or vector, or the lanes of
+ * a constant matrix in column-major order. Returns false as soon as any
+ * part is not a plain floating point constant.
+ */
+static bool GetConstantLanes(llvm::Value *v, std::vector<float> &lanes) {
+    llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(v);
+    if (!c)
+        return false;
+    llvm::Type *ty = c->getType();
+    if (ty->isFloatTy()) {
+        llvm::ConstantFP *fp = llvm::dyn_cast<llvm::ConstantFP>(c);
+        if (!fp)
+            return false;
+        lanes.push_back(fp->getValueAPF().convertToFloat());
+        return true;
+    }
+    unsigned n;
+    if (ty->isVectorTy())
+        n = ty->getVectorNumElements();
+    else if (ty->isArrayTy())
+        n = ty->getArrayNumElements();
+    else
+        return false;
+    for (unsigned i = 0; i < n; i++) {
+        llvm::Constant *elem = c->getAggregateElement(i);
+        if (!elem || !GetConstantLanes(elem, lanes))
+            return false;
+    }
+    return true;
+}
+
+static float FoldBinOp(llvm::Instruction::BinaryOps op, float a, float b) {
+    switch (op) {
+      case llvm::Instruction::FAdd: return a + b;
+      case llvm::Instruction::FSub: return a - b;
+      case llvm::Instruction::FMul: return a * b;
+      default:                      return a / b;
+    }
+}
+
+llvm::Constant *IRGenerator::GetConstantVector(const std::vector<float> &lanes,
+                                               unsigned first,
+                                               unsigned count) const {
+    std::vector<llvm::Constant *> elems;
+    for (unsigned i = 0; i < count; i++)
+        elems.push_back(llvm::ConstantFP::get(GetFloatType(),
+                                              lanes[first + i]));
+    return llvm::ConstantVector::get(elems);
+}
+
+llvm::Constant *IRGenerator::GetConstantMatrix(const std::vector<float> &lanes,
+                                               unsigned size) const {
+    std::vector<llvm::Constant *> cols;
+    for (unsigned c = 0; c < size; c++)
+        cols.push_back(GetConstantVector(lanes, c * size, size));
+    return llvm::ConstantArray::get(
+        llvm::cast<llvm::ArrayType>(GetMatType(size)), cols);
+}
+
+llvm::Value *IRGenerator::GetColumn(llvm::Value *mat, unsigned col) {
+    if (llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(mat))
+        return c->getAggregateElement(col);
+    return llvm::ExtractValueInst::Create(mat, col, "", currentBB);
+}
+
+/* Assembles a matrix from its columns. All-constant columns give a
+ * ConstantArray, otherwise the columns are chained with insertvalue.
+ */
+llvm::Value *IRGenerator::BuildMatrix(llvm::Type *ty,
+                                      std::vector<llvm::Value *> &cols) {
+    std::vector<llvm::Constant *> consts;
+    for (unsigned c = 0; c < cols.size(); c++)
+        if (llvm::Constant *k = llvm::dyn_cast<llvm::Constant>(cols[c]))
+            consts.push_back(k);
+    if (consts.size() == cols.size())
+        return llvm::ConstantArray::get(llvm::cast<llvm::ArrayType>(ty),
+                                        consts);
+    llvm::Value *mat = llvm::UndefValue::get(ty);
+    for (unsigned c = 0; c < cols.size(); c++)
+        mat = llvm::InsertValueInst::Create(mat, cols[c], c, "", currentBB);
+    return mat;
+}
+
+/* Row r of the transpose gathers lane r of every column. Each step is one
+ * two-input shufflevector that keeps the lanes gathered so far and pulls
+ * lane r out of the next column.
+ */
+llvm::Value *IRGenerator::CreateTranspose(llvm::Value *mat) {
+    unsigned n = mat->getType()->getArrayNumElements();
+    std::vector<llvm::Value *> cols, rows;
+    for (unsigned c = 0; c < n; c++)
+        cols.push_back(GetColumn(mat, c));
+    llvm::Constant *undefIdx = llvm::UndefValue::get(GetIntType());
+    for (unsigned r = 0; r < n; r++) {
+        llvm::Value *row = cols[0];
+        for (unsigned c = 1; c < n; c++) {
+            std::vector<llvm::Constant *> mask;
+            for (unsigned i = 0; i < n; i++) {
+                if (i < c)
+                    mask.push_back(llvm::ConstantInt::get(GetIntType(),
+                                                          c == 1 ? r : i));
+                else if (i == c)
+                    mask.push_back(llvm::ConstantInt::get(GetIntType(),
+                                                          n + r));
+                else
+                    mask.push_back(undefIdx);
+            }
+            row = new llvm::ShuffleVectorInst(row, cols[c],
+                llvm::ConstantVector::get(mask), "", currentBB);
+        }
+        rows.push_back(row);
+    }
+    return BuildMatrix(mat->getType(), rows);
+}
+
+/* M * v is the sum of the columns of M scaled by the matching lanes of v:
+ * one multiply for the first column and a CreateFMulAdd for every other.
+ */
+llvm::Value *IRGenerator::CreateMatVecMul(llvm::Value *mat, llvm::Value *vec) {
+    unsigned n = mat->getType()->getArrayNumElements();
+    std::vector<float> m, v;
+    if (GetConstantLanes(mat, m) && GetConstantLanes(vec, v)) {
+        // summed from the first product, like the emitted code, so a
+        // -0.0 result is not turned into +0.0
+        std::vector<float> res(n);
+        for (unsigned c = 0; c < n; c++)
+            for (unsigned r = 0; r < n; r++)
+                res[r] = c ? res[r] + m[c * n + r] * v[c] : m[r] * v[0];
+        return GetConstantVector(res, 0, n);
+    }
+    llvm::Value *acc = llvm::BinaryOperator::CreateFMul(GetColumn(mat, 0),
+        CreateLaneSplat(vec, 0), "", currentBB);
+    for (unsigned c = 1; c < n; c++)
+        acc = CreateFMulAdd(GetColumn(mat, c), CreateLaneSplat(vec, c), acc);
+    return acc;
+}
+
+llvm::Value *IRGenerator::CreateVecMatMul(llvm::Value *vec, llvm::Value *mat) {
+    unsigned n = mat->getType()->getArrayNumElements();
+    std::vector<float> m, v;
+    if (GetConstantLanes(mat, m) && GetConstantLanes(vec, v)) {
+        std::vector<float> res(n);
+        for (unsigned c = 0; c < n; c++)
+            for (unsigned r = 0; r < n; r++)
+                res[c] = r ? res[c] + v[r] * m[c * n + r] : v[0] * m[c * n];
+        return GetConstantVector(res, 0, n);
+    }
+    // v * M == transpose(M) * v
+    return CreateMatVecMul(CreateTranspose(mat), vec);
+}
+
+llvm::Value *IRGenerator::CreateMatMatMul(llvm::Value *lhs, llvm::Value *rhs) {
+    unsigned n = lhs->getType()->getArrayNumElements();
+    std::vector<float> a, b;
+    if (GetConstantLanes(lhs, a) && GetConstantLanes(rhs, b)) {
+        std::vector<float> res(n * n);
+        for (unsigned c = 0; c < n; c++)
+            for (unsigned r = 0; r < n; r++)
+                for (unsigned k = 0; k < n; k++)
+                    res[c * n + r] = k ? res[c * n + r] +
+                                         a[k * n + r] * b[c * n + k]
+                                       : a[r] * b[c * n];
+        return GetConstantMatrix(res, n);
+    }
+    std::vector<llvm::Value *> cols;
+    for (unsigned c = 0; c < n; c++)
+        cols.push_back(CreateMatVecMul(lhs, GetColumn(rhs, c)));
+    return BuildMatrix(lhs->getType(), cols);
+}
+
+llvm::Value *IRGenerator::CreateMatBinOp(llvm::Instruction::BinaryOps op,
+                                         llvm::Value *lhs, llvm::Value *rhs) {
+    unsigned n = lhs->getType()->getArrayNumElements();
+    std::vector<float> a, b;
+    if (GetConstantLanes(lhs, a) && GetConstantLanes(rhs, b)) {
+        for (unsigned i = 0; i < a.size(); i++)
+            a[i] = FoldBinOp(op, a[i], b[i]);
+        return GetConstantMatrix(a, n);
+    }
+    std::vector<llvm::Value *> cols;
+    for (unsigned c = 0; c < n; c++)
+        cols.push_back(llvm::BinaryOperator::Create(op, GetColumn(lhs, c),
+            GetColumn(rhs, c), "", currentBB));
+    return BuildMatrix(lhs->getType(), cols);
+}
+
+llvm::Value *IRGenerator::CreateMatScalarOp(llvm::Instruction::BinaryOps op,
+                                            llvm::Value *mat,
+                                            llvm::Value *scalar,
+                                            bool scalarFirst) {
+    unsigned n = mat->getType()->getArrayNumElements();
+    std::vector<float> m, s;
+    if (GetConstantLanes(mat, m) && GetConstantLanes(scalar, s)) {
+        for (unsigned i = 0; i < m.size(); i++)
+            m[i] = scalarFirst ? FoldBinOp(op, s[0], m[i])
+                               : FoldBinOp(op, m[i], s[0]);
+        return GetConstantMatrix(m, n);
+    }
+    llvm::Value *splat = CreateSplat(scalar, n);
+    std::vector<llvm::Value *> cols;
+    for (unsigned c = 0; c < n; c++) {
+        llvm::Value *col = GetColumn(mat, c);
+        cols.push_back(scalarFirst
+            ? llvm::BinaryOperator::Create(op, splat, col, "", currentBB)
+            : llvm::BinaryOperator::Create(op, col, splat, "", currentBB));
+    }
+    return BuildMatrix(mat->getType(), cols);
+}
+
+/* GLSL built-in functions. Everything lowers to LLVM intrinsics or plain
+ * vector code. The one exception is pow with an exponent that is not a
+ * small constant (see CreatePow).
+ */
+enum BuiltinKind {
+    B_Dot, B_Cross, B_Normalize, B_Length, B_Mix, B_Clamp, B_Min, B_Max,
+    B_Abs, B_Sqrt, B_InverseSqrt, B_Pow, B_Floor, B_Fract, B_Step,
+    B_SmoothStep, B_Fma
+};
+
+struct Builtin {
+    const char *name;
+    int numArgs;
+    BuiltinKind kind;
+    int resultArg;      // argument whose type is the result's, -1 for float
+    BuiltinArgs args;
+    bool intForm;       // also takes all-int arguments
+};
+
+static const Builtin builtins[] = {
+    { "dot",         2, B_Dot, -1, BA_Same, false },
+    { "cross",       2, B_Cross,  0, BA_Vec3, false },
+    { "normalize",   1, B_Normalize,  0, BA_Same, false },
+    { "length",      1, B_Length, -1, BA_Same, false },
+    { "mix",         3, B_Mix,  0, BA_Splat, false },
+    { "clamp",       3, B_Clamp,  0, BA_Splat, true },
+    { "min",         2, B_Min,  0, BA_Splat, true },
+    { "max",         2, B_Max,  0, BA_Splat, true },
+    { "abs",         1, B_Abs,  0, BA_Same, true },
+    { "sqrt",        1, B_Sqrt,  0, BA_Same, false },
+    { "inversesqrt", 1, B_InverseSqrt,  0, BA_Same, false },
+    { "pow",         2, B_Pow,  0, BA_Same, false },
+    { "floor",       1, B_Floor,  0, BA_Same, false },
+    { "fract",       1, B_Fract,  0, BA_Same, false },
+    { "step",        2, B_Step,  1, BA_Splat, false },
+    { "smoothstep",  3, B_SmoothStep,  2, BA_Splat, false },
+    { "fma",         3, B_Fma,  0, BA_Same, false },
+};
+
+static const Builtin *FindBuiltin(const char *name) {
+    for (unsigned i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+        if (strcmp(builtins[i].name, name) == 0)
+            return &builtins[i];
+    return NULL;
+}
+
+int IRGenerator::GetBuiltinArity(const char *name) {
+    const Builtin *b = FindBuiltin(name);
+    return b ? b->numArgs : -1;
+}
+
+int IRGenerator::GetBuiltinResultArg(const char *name) {
+    const Builtin *b = FindBuiltin(name);
+    return b ? b->resultArg : -1;
+}
+
+BuiltinArgs IRGenerator::GetBuiltinArgs(const char *name) {
+    const Builtin *b = FindBuiltin(name);
+    return b ? b->args : BA_Same;
+}
+
+bool IRGenerator::HasBuiltinIntForm(const char *name) {
+    const Builtin *b = FindBuiltin(name);
+    return b && b->intForm;
+}
+
+llvm::Value *IRGenerator::CreateIntrinsic(llvm::Intrinsic::ID id,
+                                          std::vector<llvm::Value *> &args) {
+    llvm::Function *fn = llvm::Intrinsic::getDeclaration(module, id,
+        args[0]->getType());
+    return llvm::CallInst::Create(fn, args, "", currentBB);
+}
+
+llvm::Value *IRGenerator::CreateIntrinsic(llvm::Intrinsic::ID id,
+                                          llvm::Value *arg) {
+    std::vector<llvm::Value *> args(1, arg);
+    return CreateIntrinsic(id, args);
+}
+
+llvm::Value *IRGenerator::CreateIntrinsic(llvm::Intrinsic::ID id,
+                                          llvm::Value *a, llvm::Value *b) {
+    std::vector<llvm::Value *> args;
+    args.push_back(a);
+    args.push_back(b);
+    return CreateIntrinsic(id, args);
+}
+
+/* Sums the lanes of a vector in log2(n) shuffle/add steps. Odd widths are
+ * first padded with zero lanes up to the next power of two.
+ */
+llvm::Value *IRGenerator::CreateHorizontalAdd(llvm::Value *vec) {
+    if (!vec->getType()->isVectorTy())
+        return vec;
+    llvm::Type *intTy = GetIntType();
+    unsigned n = vec->getType()->getVectorNumElements();
+    unsigned width = 1;
+    while (width < n)
+        width *= 2;
+    if (width != n) {
+        std::vector<llvm::Constant *> pad;
+        for (unsigned i = 0; i < width; i++)
+            pad.push_back(llvm::ConstantInt::get(intTy, i < n ? i : n));
+        vec = new llvm::ShuffleVectorInst(vec,
+            llvm::ConstantAggregateZero::get(vec->getType()),
+            llvm::ConstantVector::get(pad), "", currentBB);
+    }
+    for (unsigned half = width / 2; half > 0; half /= 2) {
+        std::vector<llvm::Constant *> mask;
+        for (unsigned i = 0; i < width; i++) {
+            if (i < half)
+                mask.push_back(llvm::ConstantInt::get(intTy, i + half));
+            else
+                mask.push_back(llvm::UndefValue::get(intTy));
+        }
+        llvm::Value *hi = new llvm::ShuffleVectorInst(vec,
+            llvm::UndefValue::get(vec->getType()),
+            llvm::ConstantVector::get(mask), "", currentBB);
+        vec = llvm::BinaryOperator::CreateFAdd(vec, hi, "", currentBB);
+    }
+    return llvm::ExtractElementInst::Create(vec,
+        llvm::ConstantInt::get(intTy, 0), "", currentBB);
+}
+
+llvm::Value *IRGenerator::CreateDot(llvm::Value *a, llvm::Value *b) {
+    llvm::Value *prod = llvm::BinaryOperator::CreateFMul(a, b, "", currentBB);
+    return CreateHorizontalAdd(prod);
+}
+
+static llvm::Value *CreateSwizzle3(llvm::Value *v, int x, int y, int z,
+                                   llvm::BasicBlock *bb) {
+    llvm::Type *intTy = llvm::Type::getInt32Ty(bb->getContext());
+    llvm::Constant *lanes[] = { llvm::ConstantInt::get(intTy, x),
+                                llvm::ConstantInt::get(intTy, y),
+                                llvm::ConstantInt::get(intTy, z) };
+    return new llvm::ShuffleVectorInst(v, llvm::UndefValue::get(v->getType()),
+        llvm::ConstantVector::get(lanes), "", bb);
+}
+
+/* pow with a small constant exponent is expanded into multiplies and
+ * sqrt. Anything else stays llvm.pow, which the backend turns into a call
+ * to powf: there is no inline expansion that is accurate for every x and
+ * y, and exp2(y * log2(x)) would only trade it for exp2f and log2f calls.
+ */
+llvm::Value *IRGenerator::CreatePow(llvm::Value *x, llvm::Value *y) {
+    std::vector<float> lanes;
+    if (GetConstantLanes(y, lanes)) {
+        bool uniform = true;
+        for (unsigned i = 1; i < lanes.size(); i++)
+            uniform = uniform && lanes[i] == lanes[0];
+        float e = lanes[0];
+        if (uniform && e == 0.5f)
+            return CreateIntrinsic(llvm::Intrinsic::sqrt, x);
+        if (uniform && e >= 1.0f && e <= 4.0f && e == (int) e) {
+            llvm::Value *result = x;
+            for (int i = 1; i < (int) e; i++)
+                result = llvm::BinaryOperator::CreateFMul(result, x, "",
+                                                          currentBB);
+            return result;
+        }
+    }
+    return CreateIntrinsic(llvm::Intrinsic::pow, x, y);
+}
+
+static llvm::Value *CreateIntSelect(llvm::CmpInst::Predicate pred,
+                                    llvm::Value *a, llvm::Value *b,
+                                    llvm::BasicBlock *bb) {
+    llvm::Value *cmp = new llvm::ICmpInst(*bb, pred, a, b);
+    return llvm::SelectInst::Create(cmp, a, b, "", bb);
+}
+
+/* Integer min/max/clamp/abs are compare and select. */
+llvm::Value *IRGenerator::CreateIntBuiltin(int kind,
+                                           std::vector<llvm::Value *> &args) {
+    switch (kind) {
+      case B_Min:
+        return CreateIntSelect(llvm::CmpInst::ICMP_SLT, args[0], args[1],
+                               currentBB);
+      case B_Max:
+        return CreateIntSelect(llvm::CmpInst::ICMP_SGT, args[0], args[1],
+                               currentBB);
+      case B_Clamp: {
+        llvm::Value *lo = CreateIntSelect(llvm::CmpInst::ICMP_SGT, args[0],
+                                          args[1], currentBB);
+        return CreateIntSelect(llvm::CmpInst::ICMP_SLT, lo, args[2],
+                               currentBB);
+      }
+      default: {
+        llvm::Value *neg = llvm::BinaryOperator::CreateNeg(args[0], "",
+                                                           currentBB);
+        return CreateIntSelect(llvm::CmpInst::ICMP_SGT, args[0], neg,
+                               currentBB);
+      }
+    }
+}
+
+/* Emits the built-in called name, in its int form when ints is set.
+ * Returns NULL when there is no such built-in or the argument count is
+ * wrong. Float arguments are widened to the vector width of the call
+ * (min(v, 1.0), mix(a, b, t), ...).
+ */
+llvm::Value *IRGenerator::CreateBuiltinCall(const char *name, bool ints,
+                                            std::vector<llvm::Value *> &args) {
+    const Builtin *b = FindBuiltin(name);
+    if (!b || b->numArgs != (int) args.size())
+        return NULL;
+    if (ints)
+        return CreateIntBuiltin(b->kind, args);
+
+    llvm::Type *ty = GetFloatType();
+    for (unsigned i = 0; i < args.size(); i++)
+        if (args[i]->getType()->isVectorTy())
+            ty = args[i]->getType();
+    for (unsigned i = 0; i < args.size(); i++)
+        args[i] = CreateConversion(args[i], ty);
+
+    llvm::Constant *zero = llvm::ConstantFP::get(ty, 0.0);
+    llvm::Constant *one = llvm::ConstantFP::get(ty, 1.0);
+    switch (b->kind) {
+      case B_Dot:
+        return CreateDot(args[0], args[1]);
+      case B_Length:
+        if (!ty->isVectorTy())
+            return CreateIntrinsic(llvm::Intrinsic::fabs, args[0]);
+        return CreateIntrinsic(llvm::Intrinsic::sqrt,
+                               CreateDot(args[0], args[0]));
+      case B_Normalize: {
+        llvm::Value *len = CreateIntrinsic(llvm::Intrinsic::sqrt,
+                                           CreateDot(args[0], args[0]));
+        llvm::Value *inv = llvm::BinaryOperator::CreateFDiv(
+            llvm::ConstantFP::get(GetFloatType(), 1.0), len, "", currentBB);
+        if (ty->isVectorTy())
+            inv = CreateSplat(inv, ty->getVectorNumElements());
+        return llvm::BinaryOperator::CreateFMul(args[0], inv, "", currentBB);
+      }
+      case B_Cross: {
+        // a.yzx * b.zxy - a.zxy * b.yzx
+        llvm::Value *l = llvm::BinaryOperator::CreateFMul(
+            CreateSwizzle3(args[0], 1, 2, 0, currentBB),
+            CreateSwizzle3(args[1], 2, 0, 1, currentBB), "", currentBB);
+        llvm::Value *r = llvm::BinaryOperator::CreateFMul(
+            CreateSwizzle3(args[0], 2, 0, 1, currentBB),
+            CreateSwizzle3(args[1], 1, 2, 0, currentBB), "", currentBB);
+        return llvm::BinaryOperator::CreateFSub(l, r, "", currentBB);
+      }
+      case B_Mix: {
+        // x + (y - x) * a
+        llvm::Value *d = llvm::BinaryOperator::CreateFSub(args[1], args[0],
+                                                          "", currentBB);
+        return CreateFMulAdd(d, args[2], args[0]);
+      }
+      case B_Clamp:
+        return CreateIntrinsic(llvm::Intrinsic::minnum,
+            CreateIntrinsic(llvm::Intrinsic::maxnum, args[0], args[1]),
+            args[2]);
+      case B_Min:
+        return CreateIntrinsic(llvm::Intrinsic::minnum, args);
+      case B_Max:
+        return CreateIntrinsic(llvm::Intrinsic::maxnum, args);
+      case B_Abs:
+        return CreateIntrinsic(llvm::Intrinsic::fabs, args);
+      case B_Sqrt:
+        return CreateIntrinsic(llvm::Intrinsic::sqrt, args);
+      case B_InverseSqrt:
+        return llvm::BinaryOperator::CreateFDiv(one,
+            CreateIntrinsic(llvm::Intrinsic::sqrt, args), "", currentBB);
+      case B_Pow:
+        return CreatePow(args[0], args[1]);
+      case B_Floor:
+        return CreateIntrinsic(llvm::Intrinsic::floor, args);
+      case B_Fract:
+        return llvm::BinaryOperator::CreateFSub(args[0],
+            CreateIntrinsic(llvm::Intrinsic::floor, args[0]), "", currentBB);
+      case B_Step: {
+        llvm::Value *lt = new llvm::FCmpInst(*currentBB,
+            llvm::CmpInst::FCMP_OLT, args[1], args[0]);
+        return llvm::SelectInst::Create(lt, zero, one, "", currentBB);
+      }
+      case B_SmoothStep: {
+        // t = clamp((x - e0) / (e1 - e0), 0, 1); t * t * (3 - 2 * t)
+        llvm::Value *num = llvm::BinaryOperator::CreateFSub(args[2], args[0],
+                                                            "", currentBB);
+        llvm::Value *den = llvm::BinaryOperator::CreateFSub(args[1], args[0],
+                                                            "", currentBB);
+        llvm::Value *t = llvm::BinaryOperator::CreateFDiv(num, den, "",
+                                                          currentBB);
+        t = CreateIntrinsic(llvm::Intrinsic::minnum,
+            CreateIntrinsic(llvm::Intrinsic::maxnum, t, zero), one);
+        llvm::Value *poly = CreateFMulAdd(llvm::ConstantFP::get(ty, -2.0), t,
+                                          llvm::ConstantFP::get(ty, 3.0));
+        llvm::Value *t2 = llvm::BinaryOperator::CreateFMul(t, t, "",
+                                                           currentBB);
+        return llvm::BinaryOperator::CreateFMul(t2, poly, "", currentBB);
+      }
+      case B_Fma:
+        return CreateIntrinsic(llvm::Intrinsic::fma, args);
+    }
+    return NULL;
+}
+
+const unsigned IRGenerator::InlineThreshold = 40;
+
 const char *IRGenerator::TargetLayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128";
 
 const char *IRGenerator::TargetTriple = "x86_64-redhat-linux-gnu";
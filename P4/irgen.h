@@ -16,6 +16,17 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/ValueHandle.h"
+#include <string>
+#include <vector>
+
+// what a built-in function accepts as arguments
+enum BuiltinArgs {
+    BA_Same,    // float or float vector arguments, all of one type
+    BA_Splat,   // as BA_Same, except that any argument may be a float
+    BA_Vec3     // vec3 arguments
+};
 
 class IRGenerator {
   public:
@@ -44,7 +55,97 @@ class IRGenerator {
     llvm::Type *GetMat4Type() const;
     llvm::Type *GetErrorType() const;
 
+    llvm::Type *GetMatType(unsigned size) const;
+
+    // stack slot in the entry block of the current function
+    llvm::AllocaInst *CreateEntryAlloca(llvm::Type *ty, const char *name);
+    // implicit conversions between int, bool, float and vector operands
+    llvm::Value *CreateConversion(llvm::Value *val, llvm::Type *ty);
+
+    // terminates every block, drops unreachable ones and merges straight
+    // branch chains once the current function has been emitted
+    void FinishFunction();
+
+    // -ffast-math, -ffp-contract=on|fast and the single -fnnan, -fninf,
+    // -fnsz, -farcp, -freassoc, -fafn flags; precise regions opt out
+    bool AllowContraction() const;
+    void BeginPrecise();
+    void EndPrecise();
+
+    // calls to small leaf functions are inlined once the caller is done
+    void AddCall(llvm::CallInst *call);
+    void InlineCalls();
+
+    // -femit-threads: workers hand their modules over as bitcode, since
+    // modules of different contexts cannot be linked directly. Calls
+    // across workers are inlined after linking, callers in source order.
+    std::string WriteBitcode();
+    void LinkBitcode(const std::string &bitcode);
+    void InlineLinkedCalls(const std::vector<llvm::Function *> &fns);
+
+    // int add/sub/mul. GLSL ints wrap; -fstrict-overflow opts in to
+    // assuming they never overflow, and only then is nsw set
+    llvm::Value *CreateIntOp(llvm::Instruction::BinaryOps op,
+                             llvm::Value *lhs, llvm::Value *rhs);
+
+    // broadcast a scalar into every lane of an n-wide vector
+    llvm::Value *CreateSplat(llvm::Value *scalar, unsigned numElements);
+    llvm::Value *CreateLaneSplat(llvm::Value *vec, unsigned lane);
+    // a * b + c, fused only where AllowContraction()
+    llvm::Value *CreateFMulAdd(llvm::Value *a, llvm::Value *b, llvm::Value *c);
+
+    // matrices are [N x <N x float>] arrays of columns; all arithmetic on
+    // them stays column-wise in vector registers
+    // reduce an <N x i1> lane mask to a single i1
+    llvm::Value *CreateAllOf(llvm::Value *mask);
+    llvm::Value *CreateAnyOf(llvm::Value *mask);
+    // == (equal) or != on vectors and matrices
+    llvm::Value *CreateAggregateCompare(bool equal, llvm::Value *lhs,
+                                        llvm::Value *rhs);
+
+    // a scalar (lane -1) or one lane of a vector, for constructors
+    typedef std::pair<llvm::Value *, int> Component;
+    llvm::Value *BuildVector(llvm::Type *ty, std::vector<Component> &comps);
+
+    llvm::Value *GetColumn(llvm::Value *mat, unsigned col);
+    llvm::Value *BuildMatrix(llvm::Type *ty, std::vector<llvm::Value *> &cols);
+    llvm::Value *CreateTranspose(llvm::Value *mat);
+    llvm::Value *CreateMatVecMul(llvm::Value *mat, llvm::Value *vec);
+    llvm::Value *CreateVecMatMul(llvm::Value *vec, llvm::Value *mat);
+    llvm::Value *CreateMatMatMul(llvm::Value *lhs, llvm::Value *rhs);
+    llvm::Value *CreateMatBinOp(llvm::Instruction::BinaryOps op,
+                                llvm::Value *lhs, llvm::Value *rhs);
+    llvm::Value *CreateMatScalarOp(llvm::Instruction::BinaryOps op,
+                                   llvm::Value *mat, llvm::Value *scalar,
+                                   bool scalarFirst);
+
+    // GLSL built-in functions
+    static int GetBuiltinArity(const char *name);
+    static int GetBuiltinResultArg(const char *name);
+    static BuiltinArgs GetBuiltinArgs(const char *name);
+    static bool HasBuiltinIntForm(const char *name);
+    llvm::Value *CreateBuiltinCall(const char *name, bool ints,
+                                   std::vector<llvm::Value *> &args);
+    llvm::Value *CreateHorizontalAdd(llvm::Value *vec);
+    llvm::Value *CreateDot(llvm::Value *a, llvm::Value *b);
+
   private:
+    llvm::Value *CreateIntrinsic(llvm::Intrinsic::ID id,
+                                 std::vector<llvm::Value *> &args);
+    llvm::Value *CreateIntrinsic(llvm::Intrinsic::ID id, llvm::Value *arg);
+    llvm::Value *CreateIntrinsic(llvm::Intrinsic::ID id, llvm::Value *a,
+                                 llvm::Value *b);
+    llvm::Value *CreatePow(llvm::Value *x, llvm::Value *y);
+    llvm::Value *CreateIntBuiltin(int kind, std::vector<llvm::Value *> &args);
+
+    bool IsInlineCandidate(llvm::Function *callee) const;
+    void ApplyFastMath();
+
+    llvm::Constant *GetConstantVector(const std::vector<float> &lanes,
+                                      unsigned first, unsigned count) const;
+    llvm::Constant *GetConstantMatrix(const std::vector<float> &lanes,
+                                      unsigned size) const;
+
     llvm::LLVMContext *context;
     llvm::Module      *module;
 
@@ -52,6 +153,14 @@ class IRGenerator {
     llvm::Function    *currentFunc;
     llvm::BasicBlock  *currentBB;
 
+    // weak: FinishFunction may delete a call's block before it is inlined
+    std::vector<llvm::WeakVH> pendingInlines;
+
+    // open precise regions: the block and its last instruction on entry
+    std::vector<std::pair<llvm::BasicBlock *, llvm::Instruction *> >
+        preciseMarks;
+    static const unsigned InlineThreshold;
+
     static const char *TargetTriple;
     static const char *TargetLayout;
 };
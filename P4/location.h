@@ -3,8 +3,8 @@
  * This file just contains features relative to the location structure
  * used to record the lexical position of a token or symbol.  This file
  * establishes the cmoon definition for the yyltype structure, the global
- * variable yylloc, and a utility function to join locations you might
- * find handy at times.
+ * variable yylloc, the compact SourceRange kept by AST nodes, and a
+ * utility function to join locations you might find handy at times.
  */
 
 #ifndef YYLTYPE
@@ -16,10 +16,8 @@
  */
 typedef struct yyltype
 {
-    int timestamp;                 // you can ignore this field
     int first_line, first_column;
     int last_line, last_column;      
-    char *text;                    // you can also ignore this field
 } yyltype;
 
 #define YYLTYPE yyltype
@@ -33,25 +31,38 @@ typedef struct yyltype
 extern struct yyltype yylloc;
 
 
+/* Type: SourceLoc, SourceRange
+ * ----------------------------
+ * A SourceLoc numbers every column of the input in one sequence, line
+ * after line, so a position fits in 32 bits; 0 means no location. Nodes
+ * keep a SourceRange of their first and last column instead of a
+ * yyltype. Line and column come back from the scanner's line table only
+ * when an error or the AST printer needs them.
+ */
+typedef unsigned SourceLoc;
+
+struct SourceRange
+{
+  SourceLoc begin, end;
+
+  SourceRange() : begin(0), end(0) {}
+  SourceRange(SourceLoc b, SourceLoc e) : begin(b), end(e) {}
+  SourceRange(const yyltype &loc);      // defined in scanner.l
+  bool IsValid() const { return begin != 0; }
+};
+
+int LineOf(SourceLoc loc);              // defined in scanner.l
+int ColumnOf(SourceLoc loc);            // ditto
+
+
 /* Function: Join
  * --------------
  * Takes two locations and returns a new location which represents
  * the span from first to last, inclusive.
  */
-inline yyltype Join(yyltype first, yyltype last)
-{
-  yyltype combined;
-  combined.first_column = first.first_column;
-  combined.first_line = first.first_line;
-  combined.last_column = last.last_column;
-  combined.last_line = last.last_line;
-  return combined;
-}
-
-/* Same as above, except operates on pointers as a convenience  */
-inline yyltype Join(yyltype *firstPtr, yyltype *lastPtr)
+inline SourceRange Join(SourceRange first, SourceRange last)
 {
-  return Join(*firstPtr, *lastPtr);
+  return SourceRange(first.begin, last.end);
 }
 
 
@@ -9,6 +9,7 @@
 #include "utility.h"
 #include "errors.h"
 #include "parser.h"
+#include "trace.h"
 
 
 /* Function: main()
@@ -22,9 +23,12 @@
 int main(int argc, char *argv[])
 {
     ParseCommandLine(argc, argv);
+    TraceStart();
     InitScanner();
     InitParser();
     yyparse();
+    ReportError::Flush();
+    TraceFinish();
     return (ReportError::NumErrors() == 0? 0 : -1);
 }
 
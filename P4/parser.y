@@ -50,6 +50,7 @@ void yyerror(const char *msg); // standard error-handling routine
     Expr *expression;
     VarDecl *varDecl;
     List<VarDecl *> *varDeclList;
+    List<Expr*> *exprList;
     List<Stmt*> *stmtList;
     Stmt       *stmt;
     Operator *ops;
@@ -68,7 +69,7 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   T_Mat2  T_Mat3 T_Mat4
 %token   T_While T_For T_If T_Else T_Return T_Break T_Continue T_Do 
 %token   T_Switch T_Case T_Default
-%token   T_In T_Out T_Inout T_Const T_Uniform
+%token   T_In T_Out T_Inout T_Const T_Uniform T_Precise
 %token   T_Layout
 %token   T_LeftParen T_RightParen T_LeftBracket T_RightBracket T_LeftBrace T_RightBrace
 %token   T_Dot T_Comma T_Colon T_Semicolon
@@ -84,6 +85,7 @@ void yyerror(const char *msg); // standard error-handling routine
 %token   <floatConstant> T_FloatConstant
 %token   <boolConstant> T_BoolConstant
 %token   <identifier> T_FieldSelection
+%token   <identifier> T_Pragma
 
 %nonassoc LOWEST
 %nonassoc LOWER_THAN_ELSE
@@ -110,8 +112,10 @@ void yyerror(const char *msg); // standard error-handling routine
 %type <typeDecl>  TypeDecl
 %type <expression> PrimaryExpr PostfixExpr UnaryExpr MultiExpr AdditionExpr RelationExpr
 %type <expression> EqualityExpr LogicAndExpr LogicOrExpr Expression
-%type <floatConstant> Initializer
-%type <varDecl>    SingleDecl
+%type <expression> FunctionCall
+%type <exprList>   ArgumentList
+%type <expression> Initializer
+%type <varDecl>    SingleDecl ParameterDecl
 %type <varDeclList> ParameterList
 %type <stmt>       Statement
 %type <stmtList>   StatementList
@@ -134,7 +138,7 @@ Program   :    DeclList            {
                                       Program *program = new Program($1);
                                       // if no errors, advance to next phase
                                       if (ReportError::NumErrors() == 0) {
-                                          if( IsDebugOn("ast") )
+                                          if( TraceOn(TraceAst) )
                                              program->Print(0);
 
                                           // start the LLVM IR generation
@@ -145,6 +149,8 @@ Program   :    DeclList            {
 
 DeclList  :    DeclList Decl        { ($$=$1)->Append($2); }
           |    Decl                 { ($$ = new List<Decl*>)->Append($1); }
+          |    DeclList T_Pragma    { $$ = $1; /* no loop to attach to */ }
+          |    T_Pragma             { $$ = new List<Decl*>; }
           ;
 
 /* combine external_declaration and function_definition into a single rule
@@ -184,8 +190,14 @@ FuncDecl  : TypeDecl T_Identifier T_LeftParen T_RightParen
                          }
           ;
 
-ParameterList : SingleDecl { ($$ = new List<VarDecl *>)->Append($1);  }
-              | ParameterList T_Comma SingleDecl { ($$ = $1)->Append($3); }
+ParameterList : ParameterDecl { ($$ = new List<VarDecl *>)->Append($1);  }
+              | ParameterList T_Comma ParameterDecl { ($$ = $1)->Append($3); }
+              ;
+
+ParameterDecl : SingleDecl         { $$ = $1; }
+              | T_In SingleDecl    { ($$ = $2)->SetQualifier(InQualifier); }
+              | T_Out SingleDecl   { ($$ = $2)->SetQualifier(OutQualifier); }
+              | T_Inout SingleDecl { ($$ = $2)->SetQualifier(InoutQualifier); }
               ;
 
 SingleDecl    : TypeDecl T_Identifier
@@ -195,13 +207,15 @@ SingleDecl    : TypeDecl T_Identifier
                          }
               | TypeDecl T_Identifier T_Equal Initializer
                          {
-                            // incomplete: drop the initializer here
-                            Identifier *id = new Identifier(yylloc, (const char *)$2); 
+                            Identifier *id = new Identifier(@2, (const char *)$2); 
                             $$ = new VarDecl(id, $1);
+                            $$->SetInitializer($4);
                          }
+              | T_Precise SingleDecl { ($$ = $2)->SetPrecise(true); }
+              | T_Const SingleDecl { ($$ = $2)->SetConst(true); }
               ;
 
-Initializer        : T_FloatConstant    { $$ = $1; }
+Initializer        : Expression         { $$ = $1; }
                    ;
 
 TypeDecl       : T_Int                   { $$ = Type::intType;    }
@@ -216,10 +230,19 @@ TypeDecl       : T_Int                   { $$ = Type::intType;    }
                | T_Mat4                  { $$ = Type::mat4Type;   }
                ;
 
-CompoundStatement : T_LeftBrace T_RightBrace               { $$ = new StmtBlock(new List<VarDecl*>, new List<Stmt *>); }
-                  | T_LeftBrace StatementList T_RightBrace { $$ = new StmtBlock(new List<VarDecl*>, $2); }
+CompoundStatement : T_LeftBrace BlockEnd               { $$ = new StmtBlock(new List<VarDecl*>, new List<Stmt *>); }
+                  | T_LeftBrace StatementList BlockEnd { $$ = new StmtBlock(new List<VarDecl*>, $2); }
                   ;
 
+/* pragmas trailing a block have no loop to attach to and are dropped */
+BlockEnd      : T_RightBrace                  { }
+              | Pragmas T_RightBrace          { }
+              ;
+
+Pragmas       : T_Pragma                      { }
+              | T_Pragma Pragmas              { }
+              ;
+
 StatementList : Statement                     { ($$ = new List<Stmt*>)->Append($1); }
               | StatementList Statement       { ($$ = $1)->Append($2); }
               ;
@@ -240,6 +263,13 @@ SingleStatement   : T_Semicolon      { $$ = new EmptyExpr();  }
                   | JumpStmt         { $$ = $1; }
                   | WhileStmt        { $$ = $1; }
                   | ForStmt          { $$ = $1; }
+                  | T_Pragma SingleStatement
+                                     {
+                                       // only loops take pragmas
+                                       if (LoopStmt *l = dynamic_cast<LoopStmt*>($2))
+                                           l->AddPragma($1);
+                                       $$ = $2;
+                                     }
                   ;
 
 SelectionStmt     : T_If T_LeftParen Expression T_RightParen Statement T_Else Statement
@@ -252,7 +282,7 @@ SelectionStmt     : T_If T_LeftParen Expression T_RightParen Statement T_Else St
                                      }
                    ;
 
-SwitchStmt         : T_Switch T_LeftParen Expression T_RightParen T_LeftBrace StatementList T_RightBrace
+SwitchStmt         : T_Switch T_LeftParen Expression T_RightParen T_LeftBrace StatementList BlockEnd
                                      {
                                         $$ = new SwitchStmt($3, $6, NULL);
                                      }
@@ -286,6 +316,7 @@ PrimaryExpr        : T_Identifier    { Identifier *id = new Identifier(yylloc, (
                    ;
 
 PostfixExpr        : PrimaryExpr     { $$ = $1; }
+                   | FunctionCall    { $$ = $1; }
                    | PostfixExpr T_Inc 
                                        {
                                           Operator *op = new Operator(yylloc, (const char *)$2);
@@ -303,6 +334,26 @@ PostfixExpr        : PrimaryExpr     { $$ = $1; }
                                        }
                    ;
 
+FunctionCall       : T_Identifier T_LeftParen T_RightParen
+                                       {
+                                          Identifier *id = new Identifier(@1, (const char *)$1);
+                                          $$ = new Call(@1, NULL, id, new List<Expr*>);
+                                       }
+                   | T_Identifier T_LeftParen ArgumentList T_RightParen
+                                       {
+                                          Identifier *id = new Identifier(@1, (const char *)$1);
+                                          $$ = new Call(@1, NULL, id, $3);
+                                       }
+                   | TypeDecl T_LeftParen ArgumentList T_RightParen
+                                       {
+                                          $$ = new ConstructorExpr(@1, $1, $3);
+                                       }
+                   ;
+
+ArgumentList       : Expression      { ($$ = new List<Expr*>)->Append($1); }
+                   | ArgumentList T_Comma Expression { ($$ = $1)->Append($3); }
+                   ;
+
 UnaryExpr          : PostfixExpr     { $$ = $1; }
                    | T_Inc UnaryExpr
                            {
@@ -441,6 +492,6 @@ AssignOp           : T_Equal         { $$ = new Operator(yylloc, $1);   }
  */
 void InitParser()
 {
-   PrintDebug("parser", "Initializing parser");
+   TRACE(TraceParser, "Initializing parser");
    yydebug = false;
 }
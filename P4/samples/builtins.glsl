@@ -0,0 +1,17 @@
+vec3 v;
+
+float builtins(float f)
+{
+   vec3 n;
+   vec3 c;
+   float r;
+
+   n = normalize(v);
+   r = length(v) + dot(n, v);
+   r = r + max(f, 2.0) + clamp(f, 0.0, 1.0);
+   r = r + pow(f, 2.0) + sqrt(16.0);
+   c = cross(v, vec3(0.0, 1.0, 3.0));
+   r = r + c.x - c.y + c.z + fract(2.25) + step(1.0, f);
+
+   return r;
+}
@@ -0,0 +1,22 @@
+float scale;
+
+void accumulate(inout float sum, float x)
+{
+   sum = sum + x * scale;
+}
+
+float twice(float x)
+{
+   return x * 2.0;
+}
+
+float calls(int n)
+{
+   float total;
+
+   total = 1.0;
+   accumulate(total, twice(2.5));
+   accumulate(total, n);
+
+   return total;
+}
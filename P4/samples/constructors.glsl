@@ -0,0 +1,13 @@
+vec4 base = vec4(1.0, 2.0, 3.0, 4.0);
+float g;
+
+float ctor(float f)
+{
+   vec2 a = vec2(f, 2.0);
+   vec4 b = vec4(a, a);
+   vec3 c = vec3(b.zw, f);
+   mat2 m = mat2(f);
+   vec2 d = m * a;
+
+   return b.x + b.w + c.z + d.x + d.y + base.w + float(2) + g;
+}
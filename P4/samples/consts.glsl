@@ -0,0 +1,21 @@
+const float scale = 2.0 * 0.5;
+const vec3 offset = vec3(1.0, 2.0, 3.0);
+const int steps = 3;
+const mat2 rot = mat2(2.0);
+const mat2 spin = rot;
+float bias = 0.5;
+float g;
+
+float consts(float x)
+{
+   const float half = 0.5;
+   int i;
+   float y = x * scale + offset.y;
+
+   for (i = 0; i < steps; i++) {
+      y = y + half;
+   }
+   vec2 r = spin * vec2(x, 1.0);
+
+   return y + r.x + r.y + bias + g;
+}
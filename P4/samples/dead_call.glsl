@@ -0,0 +1,24 @@
+float f(float a)
+{
+   return a + 1.0;
+}
+
+float g(float b)
+{
+   return b * 2.0;
+}
+
+float h(float x)
+{
+   return x - 1.0;
+}
+
+float dead_call(float x)
+{
+   if (x > 2.0)
+      return f(x);
+   else
+      return g(x);
+   h(x);
+   return 0.0;
+}
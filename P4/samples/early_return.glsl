@@ -0,0 +1,21 @@
+float sign3(float x)
+{
+   if (x > 0.0) {
+      return 1.0;
+   } else {
+      if (x < 0.0)
+         return -1.0;
+      else
+         return 0.0;
+   }
+}
+
+float early(float x)
+{
+   float s;
+
+   s = sign3(x) + sign3(-x) * 2.0;
+   while (true) {
+      return s + sign3(0.0);
+   }
+}
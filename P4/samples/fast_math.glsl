@@ -0,0 +1,11 @@
+float b;
+
+float fused(float a)
+{
+   precise float p = a * b + 1.0;
+   vec2 v;
+
+   v = vec2(a, b) * b - vec2(0.5, 0.5);
+   p += v.x * v.y;
+   return p;
+}
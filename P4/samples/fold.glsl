@@ -0,0 +1,17 @@
+float g;
+
+float fold(float x)
+{
+   bool b = x > 2.0;
+   vec4 v = vec4(x) * 1.0 + vec4(2.0 * 3.0, 1.0, 0.5 - 0.25, -(-x));
+   float y = -(-x) * 1.0 / 1.0 - 0.0;
+   int n = 7 / 2 + 3 * -2;
+
+   if (true && b) {
+      y = y + v.x + v.z;
+   }
+   if (false || 1 < n) {
+      y = 100.0;
+   }
+   return y + float(n) + g;
+}
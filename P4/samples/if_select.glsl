@@ -0,0 +1,21 @@
+vec2 v;
+
+float choose(float x)
+{
+   float y;
+   float z = 1.0;
+   vec2 w;
+
+   if (x > 0.0)
+      y = v.x * x;
+   else
+      y = v.y;
+
+   if (x < 2.0) {
+      z = 5.0;
+      w = v * 2.0;
+   } else
+      w = v + vec2(x, x);
+
+   return y + z + w.x + w.y;
+}
@@ -0,0 +1,22 @@
+float loops(int n)
+{
+   float s = 0.0;
+   int i;
+
+#pragma unroll(2)
+   for (i = 0; i < n; i++) {
+      s = s + 1.5;
+      if (s > 100.0)
+         break;
+   }
+
+#pragma nounroll
+   while (i > 0) {
+      i = i - 2;
+      if (i == 2)
+         continue;
+      s = s + 1.0;
+   }
+
+   return s;
+}
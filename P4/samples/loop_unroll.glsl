@@ -0,0 +1,15 @@
+float unroll(float f)
+{
+   vec4 v = vec4(1.0, 2.0, 3.0, 4.0);
+   float s = 0.0;
+   int i;
+
+   for (i = 0; i < 4; i++) {
+      if (i == 2)
+         s = s + v.z * f;
+      else
+         s = s + float(i);
+   }
+
+   return s + float(i);
+}
@@ -0,0 +1,19 @@
+float g;
+
+float matrices(float x)
+{
+   mat2 a = mat2(1.0, 2.0, x, 4.0);
+   mat2 b = mat2(0.0, 1.0, 2.0, -1.0);
+   vec2 v = vec2(1.0, 2.0);
+
+   vec2 av = v * a;
+   vec2 abv = (a * b) * v;
+   vec2 nv = -a * v;
+   vec2 z = -mat2(g - 1.0) * v;
+   float r = av.x + av.y + abv.x + abv.y + nv.x + nv.y;
+
+   if (1.0 / z.x < 0.0) {
+      r = r + 100.0;
+   }
+   return r;
+}
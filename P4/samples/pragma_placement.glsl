@@ -0,0 +1,26 @@
+#pragma optimize(on)
+
+float scale(float a)
+{
+   #pragma debug(off)
+   float s = a * 2.0;
+   return s;
+   #pragma optimize(off)
+}
+
+#pragma debug(on)
+float pragma_placement(float x)
+{
+   float sum = 0.0;
+   int i;
+   #pragma unroll
+   for (i = 0; i < 4; i++) {
+      sum += scale(x);
+      #pragma nounroll
+   }
+   if (sum > 1.0) {
+      #pragma optimize(on)
+   }
+   return sum;
+}
+#pragma debug(off)
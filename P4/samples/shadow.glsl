@@ -0,0 +1,10 @@
+float shadow(float x)
+{
+   float y = x;
+
+   if (y > 0.0) {
+      float x = 2.0;
+      y = y + x;
+   }
+   return y * x;
+}
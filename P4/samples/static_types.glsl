@@ -0,0 +1,13 @@
+float typed(float f)
+{
+   vec3 v = vec3(f, 2.0, 1.0);
+   mat3 m = mat3(2.0);
+   vec3 w = m * v;
+   int n = 2;
+
+   w.xy = w.yx;
+   if (n > 1 && w.z == 2.0) {
+      v = w + 1.0;
+   }
+   return v.x + v.y * w.z + step(1.0, f);
+}
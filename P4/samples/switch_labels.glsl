@@ -0,0 +1,11 @@
+int labels(int i) {
+  int r = 0;
+  switch(i) {
+    case -1: r = 10;
+      break;
+    case 2*3: r = 20;
+      break;
+    default: r = 30;
+  }
+  return r;
+}
@@ -0,0 +1,33 @@
+float sw(int n)
+{
+   float r = 0.0;
+   int k = n;
+
+   while (k < 5000) {
+      switch (k) {
+         case 0:
+            r = r + 1.0;
+            break;
+         case 1:
+         case 2:
+            r = r + 2.0;
+         case 3:
+            r = r + 3.0;
+            break;
+         case 4:
+            r = r + 4.0;
+            break;
+         case 100:
+            r = r + 100.0;
+            break;
+         default:
+            r = r + 0.5;
+            break;
+         case 1000:
+            return r + 1000.0;
+      }
+      k = k * 10;
+   }
+
+   return r;
+}
@@ -0,0 +1,12 @@
+vec4 v;
+
+float swizzle(float f)
+{
+   vec4 t;
+   vec2 u;
+
+   t = v.xyzw;
+   u = t.zyx.xz;
+
+   return u.x * 10.0 + u.y + t.w * f;
+}
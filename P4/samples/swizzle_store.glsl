@@ -0,0 +1,11 @@
+float swizzle_store(float x)
+{
+   vec4 v = vec4(1.0, 2.0, 3.0, 4.0);
+   v.r = x;
+   v.g += 1.0;
+   v.s++;
+   ++v.b;
+   v.zy.x = 10.0;
+   v.ba *= 2.0;
+   return v.x + v.y * 10.0 + v.z * 100.0 + v.w * 1000.0;
+}
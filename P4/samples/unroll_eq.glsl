@@ -0,0 +1,12 @@
+float g;
+
+float unroll_eq(float x)
+{
+   int i;
+   float r = x;
+
+   for (i = 0; i == 0; i++) {
+      r = r + 10.0;
+   }
+   return r + g;
+}
@@ -0,0 +1,20 @@
+vec3 v;
+
+float veq(float f)
+{
+   vec3 w = vec3(1.0, 2.0, f);
+   mat2 m = mat2(f);
+   mat2 n = mat2(3.0);
+   float r = 0.0;
+
+   if (v == w)
+      r = r + 1.0;
+   if (v != w)
+      r = r + 10.0;
+   if (m == n)
+      r = r + 100.0;
+   if (m != n)
+      r = r + 1000.0;
+
+   return r;
+}
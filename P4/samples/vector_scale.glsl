@@ -0,0 +1,13 @@
+vec3 v;
+
+float scale(float f)
+{
+   vec3 t;
+
+   t = f * v;
+   t = t + v / 2.0;
+   t *= 2.0;
+   t.xz /= 4.0;
+
+   return t.x + t.y + t.z;
+}
@@ -1,54 +1,141 @@
 #include "errors.h"
 #include "symtab.h"
 
+static const container NotFound = { NULL, NULL, INVALID };
+
 Symtab::Symtab() {
-    table = new vector<map<string, container>*>();
+    buckets.assign(64, -1);
     levelNumber = 0;
+    outer = NULL;
+    outerMark = 0;
+}
+
+// nested inside the outer table's current scope
+Symtab::Symtab(const Symtab *o, size_t mark) {
+    buckets.assign(64, -1);
+    levelNumber = o->levelNumber;
+    outer = o;
+    outerMark = mark;
 }
 
 int Symtab::getLevelNumber() {
     return levelNumber;
 }
 
+// FNV-1a
+unsigned Symtab::hash(const char *name) {
+    unsigned h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+// index of name in names, -1 if it has never been declared
+int Symtab::lookup(const char *name, unsigned h) const {
+    size_t mask = buckets.size() - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        int n = buckets[i];
+        if (n == -1)
+            return -1;
+        if (hashes[n] == h && names[n] == name)
+            return n;
+    }
+}
+
+/* Index of name in names, adding it when create is set. The table stays
+ * at most half full.
+ */
+int Symtab::intern(const char *name, bool create) {
+    unsigned h = hash(name);
+    int n = lookup(name, h);
+    if (n != -1 || !create)
+        return n;
+    size_t mask = buckets.size() - 1;
+    n = names.size();
+    names.push_back(name);
+    hashes.push_back(h);
+    heads.push_back(-1);
+    if (2 * names.size() > buckets.size())
+        grow();
+    else
+        for (size_t i = h & mask; ; i = (i + 1) & mask)
+            if (buckets[i] == -1) {
+                buckets[i] = n;
+                break;
+            }
+    return n;
+}
+
+void Symtab::grow() {
+    buckets.assign(2 * buckets.size(), -1);
+    size_t mask = buckets.size() - 1;
+    for (size_t n = 0; n < names.size(); n++)
+        for (size_t i = hashes[n] & mask; ; i = (i + 1) & mask)
+            if (buckets[i] == -1) {
+                buckets[i] = n;
+                break;
+            }
+}
+
 void Symtab::enterScope() {
-    table->push_back(new map<string,container>());
+    scopeStart.push_back(bindings.size());
     levelNumber++;
 }
 
-bool Symtab::insert(pair<string, container> var) {
+bool Symtab::insert(const pair<string, container> &var) {
     if (levelNumber <= 0) {
         cout << "No Scope" << endl;
         return false;
     }
-    if (find(var.first, levelNumber - 1).flag != INVALID) {
+    int n = intern(var.first.c_str(), true);
+    if (heads[n] != -1 && bindings[heads[n]].level == levelNumber - 1)
         return false;
-    }
-    table->at(levelNumber - 1)->insert(var);
+    binding b = { var.second, n, levelNumber - 1, heads[n] };
+    heads[n] = bindings.size();
+    bindings.push_back(b);
     return true;
 }
 
-container Symtab::find(string var, int x) {
-    map<string, container> *currMap = table->at(x);
-    map<string, container>::iterator it;
-    it = currMap->find(var);
-    if (it != currMap->end())
-        return it->second;
-    container temp = { NULL, NULL, INVALID };
-    return temp;
+container Symtab::find(const string &var, int x) {
+    int n = intern(var.c_str(), false);
+    if (n == -1)
+        return NotFound;
+    for (int b = heads[n]; b != -1 && bindings[b].level >= x;
+         b = bindings[b].prev)
+        if (bindings[b].level == x)
+            return bindings[b].c;
+    return NotFound;
 }
 
-container Symtab::find(string var) {
-    for (int i = levelNumber - 1; i >= 0; i--) {
-        container c = find(var, i);
-        if (c.flag != INVALID)
-            return c;
-    }
-    container temp = { NULL, NULL, INVALID };
-    return temp;
+container Symtab::find(const char *var) {
+    int n = intern(var, false);
+    if (n != -1 && heads[n] != -1)
+        return bindings[heads[n]].c;
+    return outer ? outer->findBefore(var, outerMark) : NotFound;
+}
+
+// innermost binding among the first mark ones; never writes to the table
+container Symtab::findBefore(const char *var, size_t mark) const {
+    int n = lookup(var, hash(var));
+    if (n == -1)
+        return NotFound;
+    for (int b = heads[n]; b != -1; b = bindings[b].prev)
+        if ((size_t)b < mark)
+            return bindings[b].c;
+    return NotFound;
+}
+
+container Symtab::find(const string &var) {
+    return find(var.c_str());
 }
 
 void Symtab::exitScope() {
-    table->pop_back();
+    size_t start = scopeStart.back();
+    scopeStart.pop_back();
+    while (bindings.size() > start) {
+        heads[bindings.back().name] = bindings.back().prev;
+        bindings.pop_back();
+    }
     levelNumber--;
 }
 
@@ -57,17 +144,17 @@ void Symtab::printTable(int x) {
         cout << x << " Invalid Level" << endl;
         return;
     }
-    map<string, container> currMap = *table->at(x);
-    if (currMap.empty()) {
+    size_t end = x + 1 < levelNumber ? scopeStart[x + 1] : bindings.size();
+    if (scopeStart[x] == end) {
         cout << "EMPTY LEVEL" << endl;
         return;
     }
-    for (map<string, container>::iterator it = currMap.begin(); it!=currMap.end(); ++it)
-        cout << it->first  << endl;
+    for (size_t b = scopeStart[x]; b < end; b++)
+        cout << names[bindings[b].name] << endl;
 }
 
 void Symtab::printTable() {
-    if (table->empty()) {
+    if (levelNumber == 0) {
         cout << "EMPTY TABLE" << endl;
         return;
     }
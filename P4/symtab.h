@@ -9,7 +9,7 @@
 #define GLOBAL 1
 #define LOCAL 0
 #define INVALID -1
-#define DEBUG 0
+#define CONSTANT 2   // val is the variable's value, e.g. an unrolled loop index
 using namespace std;
 
 class Decl;
@@ -21,17 +21,49 @@ typedef struct container {
     int flag;
 } container;
 
+/* All scopes share one open-addressing hash table of interned names. Each
+ * name heads a chain of its live bindings, innermost first, so a lookup
+ * is one probe whatever the nesting depth. Bindings are pushed on a stack
+ * in declaration order, which doubles as the undo log: leaving a scope
+ * pops its bindings and restores whatever they shadowed.
+ *
+ * A table may sit on top of a read-only outer one that it falls back to
+ * on a miss, seeing only the outer bindings made before mark. Threads
+ * resolving function bodies share the program scope this way.
+ */
 class Symtab {
     protected:
-        vector<map<string, container>*> *table;
+        struct binding {
+            container c;
+            int name;       // index into names
+            int level;
+            int prev;       // binding this one shadows, or -1
+        };
+        vector<string> names;       // interned, never removed
+        vector<unsigned> hashes;
+        vector<int> heads;          // innermost binding per name, or -1
+        vector<int> buckets;        // name index per slot, or -1
+        vector<binding> bindings;
+        vector<size_t> scopeStart;  // bindings.size() on scope entry
         int levelNumber;
+        const Symtab *outer;
+        size_t outerMark;
+
+        static unsigned hash(const char *);
+        int lookup(const char *, unsigned) const;
+        int intern(const char *, bool create);
+        void grow();
+        container findBefore(const char *, size_t) const;
     public:
         Symtab();
+        Symtab(const Symtab *outer, size_t mark);
+        size_t getMark() const { return bindings.size(); }
         int getLevelNumber();
         void enterScope();
-        bool insert(pair<string, container>);
-        container find(string, int);
-        container find(string);
+        bool insert(const pair<string, container> &);
+        container find(const string &, int);
+        container find(const string &);
+        container find(const char *);
         void exitScope();
         void printTable(int);
         void printTable();
@@ -0,0 +1,52 @@
+#! /bin/sh
+# Compiles every sample with -femit-threads=1 and -femit-threads=4. Both
+# must disassemble to the same IR, and gli must print the expected result.
+#   ./test-threads.sh [sample ...]
+
+[ -x glc ] || { echo "Error: glc not executable"; exit 1; }
+[ -x gli ] || { echo "Error: gli not executable"; exit 1; }
+
+LIST=
+if [ "$#" = "0" ]; then
+	LIST=`ls samples/*.out`
+else
+	for test in "$@"; do
+		LIST="$LIST samples/$test.out"
+	done
+fi
+
+tmp=${TMP:-"tmp"}/threads.$$
+mkdir -p $tmp
+trap 'rm -rf $tmp' 0
+
+status=0
+for file in $LIST; do
+	base=`echo $file | sed 's/\(.*\)\.out/\1/'`
+	printf "Checking %-27s: " $file
+	fail=
+	for n in 1 4; do
+		if ! ./glc -femit-threads=$n < $base.glsl > $tmp/t$n.bc 2> $tmp/log ||
+		   ! llvm-dis -o $tmp/t$n.ll $tmp/t$n.bc 2>> $tmp/log; then
+			fail="glc -femit-threads=$n failed"
+			break
+		fi
+	done
+	if [ -z "$fail" ] && ! diff $tmp/t1.ll $tmp/t4.ll > $tmp/log; then
+		fail="IR differs between 1 and 4 threads"
+	fi
+	if [ -z "$fail" ]; then
+		# gli finds the sample's .dat next to the .bc
+		cp $tmp/t4.bc $base.bc
+		./gli $base.bc 2>&1 | diff -w - $file > $tmp/log ||
+			fail="unexpected result"
+		rm -f $base.bc
+	fi
+	if [ -n "$fail" ]; then
+		echo "FAIL <-- $fail"
+		cat $tmp/log
+		status=1
+	else
+		echo "PASS"
+	fi
+done
+exit $status
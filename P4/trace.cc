@@ -0,0 +1,129 @@
+/* File: trace.cc
+ * --------------
+ * Per-thread trace ring buffers and their dumping.
+ */
+
+#include "trace.h"
+#include "utility.h"
+#include <atomic>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+unsigned traceMask = 0;
+
+static const char *categoryNames[NumTraceCategories] = {
+    "lex", "parser", "ast", "emit", "loops", "ir"
+};
+
+static const unsigned RingSize = 1024;     // entries per thread
+static const unsigned MaxRings = 64;       // threads that can record
+
+struct TraceEntry {
+    unsigned long long ns;      // since TraceStart()
+    unsigned char category;
+    char text[115];
+};
+
+/* Only the owning thread writes a ring. head counts every entry ever
+ * recorded; the last RingSize of them are still in the buffer.
+ */
+struct TraceRing {
+    std::atomic<unsigned> head;
+    TraceEntry entries[RingSize];
+};
+
+static TraceRing *rings[MaxRings];
+static std::atomic<unsigned> numRings(0);
+static thread_local TraceRing *ring = NULL;
+static struct timespec startTime;
+
+static unsigned long long Elapsed() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - startTime.tv_sec) * 1000000000ull +
+           now.tv_nsec - startTime.tv_nsec;
+}
+
+void TraceRecord(TraceCategory cat, const char *format, ...) {
+    if (ring == NULL) {
+        unsigned k = numRings.fetch_add(1);
+        if (k >= MaxRings)
+            return;
+        ring = new TraceRing();
+        ring->head = 0;
+        rings[k] = ring;
+    }
+    unsigned h = ring->head.load(std::memory_order_relaxed);
+    TraceEntry &e = ring->entries[h % RingSize];
+    e.ns = Elapsed();
+    e.category = cat;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(e.text, sizeof(e.text), format, args);
+    va_end(args);
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+bool EnableTrace(const char *name) {
+    if (strcmp(name, "all") == 0) {
+        traceMask = (1u << NumTraceCategories) - 1;
+        return true;
+    }
+    for (int i = 0; i < NumTraceCategories; i++)
+        if (strcmp(name, categoryNames[i]) == 0) {
+            traceMask |= 1u << i;
+            return true;
+        }
+    return false;
+}
+
+void TraceDump(int fd) {
+    unsigned n = numRings.load();
+    if (n > MaxRings)
+        n = MaxRings;
+    char line[192];
+    for (unsigned r = 0; r < n; r++) {
+        TraceRing *t = rings[r];
+        if (t == NULL)
+            continue;
+        unsigned head = t->head.load(std::memory_order_acquire);
+        unsigned first = head > RingSize ? head - RingSize : 0;
+        int len = snprintf(line, sizeof(line),
+                           "+++ trace of thread %u (%u entries, %u dropped)\n",
+                           r, head - first, first);
+        write(fd, line, len);
+        for (unsigned i = first; i < head; i++) {
+            TraceEntry &e = t->entries[i % RingSize];
+            len = snprintf(line, sizeof(line), "+++ %10.3fms (%s): %s\n",
+                           e.ns / 1e6, categoryNames[e.category], e.text);
+            write(fd, line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+        }
+    }
+}
+
+static void DumpOnSignal(int sig) {
+    TraceDump(STDERR_FILENO);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void TraceStart() {
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    if (traceMask == 0)
+        return;
+    int fatal[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (unsigned i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++)
+        signal(fatal[i], DumpOnSignal);
+}
+
+void TraceFinish() {
+    if (traceMask == 0)
+        return;
+    int slow = GetIntOption("trace-slow", 0);
+    if (IsOptionOn("trace-dump") ||
+        (slow > 0 && Elapsed() / 1000000 >= (unsigned long long)slow))
+        TraceDump(STDERR_FILENO);
+}
@@ -0,0 +1,54 @@
+/* File: trace.h
+ * -------------
+ * Tracing by category. Each category is one bit of traceMask, so a
+ * disabled trace point costs a load and a test. Enabled ones format their
+ * message into a fixed-size ring buffer owned by the calling thread; no
+ * locks and no allocation on that path. The buffers are written out on a
+ * crash, at exit with -ftrace-dump, or when the compile took longer than
+ * -ftrace-slow=<ms>.
+ *
+ * Building with -DNTRACE (make NTRACE=1) removes every TRACE point.
+ * TraceOn stays live there: -d ast and -d ir select output, not tracing.
+ */
+
+#ifndef _H_trace
+#define _H_trace
+
+enum TraceCategory {
+    TraceLex,       // -d lex
+    TraceParser,    // -d parser
+    TraceAst,       // -d ast: print the tree before emission
+    TraceEmit,      // -d emit: one line per node emitted
+    TraceLoops,     // -d loops: unrolling and loop pragmas
+    TraceIR,        // -d ir: textual IR instead of bitcode on stdout
+    NumTraceCategories
+};
+
+extern unsigned traceMask;
+
+#define TraceOn(cat) ((traceMask & (1u << (cat))) != 0)
+#ifdef NTRACE
+#define TRACE(cat, ...) ((void)0)
+#else
+#define TRACE(cat, ...) \
+    (TraceOn(cat) ? TraceRecord(cat, __VA_ARGS__) : (void)0)
+#endif
+
+void TraceRecord(TraceCategory cat, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Turns on the category called name ("all" for every one); false if
+ * there is no such category.
+ */
+bool EnableTrace(const char *name);
+
+// writes every thread's buffer to fd, oldest entry first
+void TraceDump(int fd);
+
+// called from main(): dump on fatal signals, and record the start time
+// for -ftrace-slow
+void TraceStart();
+// called at the end of main(): dump if asked for or if the compile was slow
+void TraceFinish();
+
+#endif
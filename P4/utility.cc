@@ -1,16 +1,18 @@
 /* File: utiliy.cc
  * ---------------
- * Implementation of simple printing functions to report failures or
- * debugging information triggered by keys.
+ * Implementation of simple printing functions to report failures, and of
+ * the command line options.
  */
 
 #include "utility.h"
+#include "trace.h"
 #include <stdarg.h>
 #include <string.h>
 #include <vector>
 using std::vector;
 
-static vector<const char*> debugKeys;
+static vector<const char*> optionKeys;
+static vector<const char*> optionValues;
 static const int BufferSize = 2048;
 
 void Failure(const char *format, ...) {
@@ -25,52 +27,69 @@ void Failure(const char *format, ...) {
   abort();
 }
 
-int IndexOf(const char *key) {
-  for (unsigned int i = 0; i < debugKeys.size(); i++)
-    if (!strcmp(debugKeys[i], key)) 
+static int OptionIndexOf(const char *key) {
+  for (unsigned int i = 0; i < optionKeys.size(); i++)
+    if (!strcmp(optionKeys[i], key))
       return i;
 
   return -1;
 }
 
-bool IsDebugOn(const char *key) {
-  return (IndexOf(key) != -1);
+void SetOptionForKey(const char *key, const char *value) {
+  int k = OptionIndexOf(key);
+  if (k == -1) {
+    optionKeys.push_back(key);
+    optionValues.push_back(value);
+  } else {
+    optionValues[k] = value;
+  }
 }
 
-void SetDebugForKey(const char *key, bool value) {
-  int k = IndexOf(key);
-  if (!value && k != -1)
-    debugKeys.erase(debugKeys.begin() + k);
-  else if (value && k == -1)
-    debugKeys.push_back(key);
+const char *GetOption(const char *key) {
+  int k = OptionIndexOf(key);
+  return k == -1 ? NULL : optionValues[k];
 }
 
-void PrintDebug(const char *key, const char *format, ...) {
-  va_list args;
-  char buf[BufferSize];
+int GetIntOption(const char *key, int defaultValue) {
+  const char *value = GetOption(key);
+  return value ? atoi(value) : defaultValue;
+}
 
-  if (!IsDebugOn(key))
-     return;
-  
-  va_start(args, format);
-  vsprintf(buf, format, args);
-  va_end(args);
-  printf("+++ (%s): %s%s", key, buf, buf[strlen(buf)-1] != '\n'? "\n" : "");
+bool IsOptionOn(const char *key) {
+  const char *value = GetOption(key);
+  return value && strcmp(value, "0") != 0;
 }
 
 void ParseCommandLine(int argc, char *argv[]) {
   if (argc == 1)
     return;
+
+  int i = 1;
+  for (; i < argc && (strncmp(argv[i], "-f", 2) == 0 ||
+                     strncmp(argv[i], "--", 2) == 0) && argv[i][2]; i++) {
+    char *key = argv[i] + 2;
+    char *eq = strchr(key, '=');
+    if (eq) {
+      *eq = '\0';
+      SetOptionForKey(key, eq + 1);
+    } else {
+      SetOptionForKey(key, "1");
+    }
+  }
+  if (i == argc)
+    return;
   
-  if (strcmp(argv[1], "-d") != 0) { // first arg is not -d
+  if (strcmp(argv[i], "-d") != 0) { // remaining args do not start with -d
     printf("Incorrect Use:   ");
-    for (int i = 1; i < argc; i++) printf("%s ", argv[i]);
+    for (int j = 1; j < argc; j++) printf("%s ", argv[j]);
     printf("\n");
-    printf("Correct Usage:   -d <debug-key-1> <debug-key-2> ... \n");
+    printf("Correct Usage:   -f<option>[=<value>] ... -d <debug-key-1> <debug-key-2> ... \n");
+    printf("                 (--<option>[=<value>] is accepted for -f)\n");
     exit(2);
   }
 
-  for (int i = 2; i < argc; i++)
-    SetDebugForKey(argv[i], true);
+  for (i++; i < argc; i++)
+    if (!EnableTrace(argv[i]))
+      fprintf(stderr, "Unknown debug key: %s\n", argv[i]);
 }
 
@@ -1,7 +1,7 @@
 /* File: utility.h
  * ---------------
  * This file just includes a few support functions you might find
- * helpful in writing the projects (error handling, debug printing)
+ * helpful in writing the projects (error handling, options)
  */
 
 #ifndef _H_utility
@@ -40,45 +40,34 @@ void Failure(const char *format, ...);
   ((expr) ? (void)0 : Failure("Assertion failed: %s, line %d:\n    %s", __FILE__, __LINE__, #expr))
 
 /**
- * Function: PrintDebug()
- * Usage: PrintDebug("parser", "found ident %s\n", ident);
- * -------------------------------------------------------
- * Print a message if we have turned debugging messages on for the given
- * key.  For example, the usage line shown above will only print a message
- * if the call is preceded by a call to SetDebugForKey("parser",true).
- * The function accepts printf arguments.  The provided main.cc parses
- * the command line to turn on debug flags. 
+ * Function: SetOptionForKey()
+ * Usage: SetOptionForKey("if-convert-cost", "4");
+ * -----------------------------------------------
+ * Record a code generation option. Options come from -f<key>=<value>
+ * (or just -f<key>, which sets the value "1") on the command line.
  */
 
-void PrintDebug(const char *key, const char *format, ...);
+void SetOptionForKey(const char *key, const char *value);
 
 /**
- * Function: SetDebugForKey()
- * Usage: SetDebugForKey("scope", true);
- * -------------------------------------
- * Turn on debugging messages for the given key.  See PrintDebug
- * for an example. Can be called manually when desired and will
- * be called from the provided main for flags passed with -d.
+ * Function: GetOption() / GetIntOption() / IsOptionOn()
+ * Usage: int cost = GetIntOption("if-convert-cost", 8);
+ * ----------------------------------------------------
+ * Look up an option. GetOption returns NULL and GetIntOption returns the
+ * given default when the option was never set. IsOptionOn is true for
+ * any value other than "0".
  */
 
-void SetDebugForKey(const char *key, bool val);
-
-/**
- * Function: IsDebugOn()
- * Usage: if (IsDebugOn("scope")) ...
- * ----------------------------------
- * Return true/false based on whether this key is currently on
- * for debug printing.
- */
-
-bool IsDebugOn(const char *key);
+const char *GetOption(const char *key);
+int GetIntOption(const char *key, int defaultValue);
+bool IsOptionOn(const char *key);
 
 /**
  * Function: ParseCommandLine
  * --------------------------
- * Turn on the debugging flags from the command line.  Verifies that
- * first argument is -d, and then interpret all the arguments that follow
- * as being flags to turn on.
+ * Turn on the debugging flags and options from the command line.  Any
+ * -f<key>[=<value>] options come first, then optionally -d followed by
+ * the trace categories to turn on (see trace.h). --<key>[=<value>] is the same as -f.
  */
 
 void ParseCommandLine(int argc, char *argv[]);